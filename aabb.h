@@ -0,0 +1,106 @@
+#ifndef RAYTRACER_AABB_H
+#define RAYTRACER_AABB_H
+
+#include "ray.h"
+#include "vec3.h"
+#include <algorithm>
+#include <limits>
+
+/**
+ * Axis-aligned bounding box. A default constructed box is empty and can be grown with expand().
+ */
+template<typename T>
+class AabbT {
+public:
+    AabbT() : minimum(infinity, infinity, infinity), maximum(-infinity, -infinity, -infinity) {}
+
+    AabbT(const Vec3T<T> &a, const Vec3T<T> &b) : minimum(std::min(a.x(), b.x()), std::min(a.y(), b.y()), std::min(a.z(), b.z())),
+                                                  maximum(std::max(a.x(), b.x()), std::max(a.y(), b.y()), std::max(a.z(), b.z())) {}
+
+    [[nodiscard]] const Vec3T<T> &min() const { return minimum; }
+
+    [[nodiscard]] const Vec3T<T> &max() const { return maximum; }
+
+    [[nodiscard]] bool isEmpty() const {
+        return minimum.x() > maximum.x() || minimum.y() > maximum.y() || minimum.z() > maximum.z();
+    }
+
+    [[nodiscard]] Vec3T<T> centroid() const {
+        return T(0.5) * (minimum + maximum);
+    }
+
+    [[nodiscard]] Vec3T<T> extent() const {
+        return maximum - minimum;
+    }
+
+    [[nodiscard]] T surfaceArea() const {
+        if (isEmpty()) {
+            return 0;
+        }
+        auto d = extent();
+        return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
+
+    /**
+     *
+     * @return the index of the axis along which the box is the widest.
+     */
+    [[nodiscard]] int longestAxis() const {
+        auto d = extent();
+        if (d.x() > d.y() && d.x() > d.z()) {
+            return 0;
+        }
+        return d.y() > d.z() ? 1 : 2;
+    }
+
+    void expand(const Vec3T<T> &p) {
+        minimum = Vec3T<T>(std::min(minimum.x(), p.x()), std::min(minimum.y(), p.y()), std::min(minimum.z(), p.z()));
+        maximum = Vec3T<T>(std::max(maximum.x(), p.x()), std::max(maximum.y(), p.y()), std::max(maximum.z(), p.z()));
+    }
+
+    void expand(const AabbT &box) {
+        if (box.isEmpty()) {
+            return;
+        }
+        expand(box.minimum);
+        expand(box.maximum);
+    }
+
+    /**
+     * Slab test against the box. The far distance of every slab is enlarged by the worst-case rounding error of
+     * its computation (Ize, "Robust BVH Ray Traversal", JCGT 2013), so a ray that grazes an edge or corner of the
+     * box is never rejected; watertight primitive tests rely on this.
+     *
+     * @param invDir component-wise reciprocal of the ray direction.
+     * @return true if the ray overlaps the box somewhere in [tMin, tMax].
+     */
+    [[nodiscard]] bool hit(const RayT<T> &r, const Vec3T<T> &invDir, T tMin, T tMax) const {
+        const auto &orig = r.origin();
+        for (int axis = 0; axis < 3; axis++) {
+            auto t0 = (minimum[axis] - orig[axis]) * invDir[axis];
+            auto t1 = (maximum[axis] - orig[axis]) * invDir[axis];
+            if (invDir[axis] < 0) {
+                std::swap(t0, t1);
+            }
+            t1 *= slabErrorScale;
+            tMin = t0 > tMin ? t0 : tMin;
+            tMax = t1 < tMax ? t1 : tMax;
+            if (tMax < tMin) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    static constexpr T infinity = std::numeric_limits<T>::infinity();
+    // 1 + 2 * gamma(3), where gamma(n) = n * u / (1 - n * u) bounds the error of n roundings with unit roundoff u.
+    static constexpr T slabErrorScale = 1 + 2 * (3 * std::numeric_limits<T>::epsilon() / 2) / (1 - 3 * std::numeric_limits<T>::epsilon() / 2);
+
+    Vec3T<T> minimum;
+    Vec3T<T> maximum;
+};
+
+using Aabb = AabbT<Real>;
+
+#endif//RAYTRACER_AABB_H
@@ -0,0 +1,887 @@
+#include "camera.h"
+#include "closed_scene.h"
+#include "color.h"
+#include "dielectric.h"
+#include "dynamic_resolution.h"
+#include "image_compare.h"
+#include "lambertian.h"
+#include "lights.h"
+#include "metal.h"
+#include "renderer.h"
+#include "scenes.h"
+#include "sphere.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Micro benchmarks of the render core, fixed-seed end-to-end renders of randomScene, the latency of the first
+ * image after a reset, the quality of reprojection after a camera move, the quality and cost of denoising, the
+ * effect of Russian roulette at equal render time, the convergence of a scene lit by small lights with and without
+ * sampling them directly, the throughput of the closed scene against the virtual path, the error after a change of
+ * resolution and the render scale that dynamic resolution settles on, reported as JSON.
+ *
+ * Every micro benchmark folds its results into a checksum that is printed with the report, so the compiler cannot
+ * drop the measured calls.
+ */
+
+struct BenchOptions {
+    bool isQuick = false;
+    double minSeconds = 0.25;// per micro benchmark
+    int samplesPerPixel = 4; // per end-to-end render
+    std::string outputPath;  // empty: stdout
+};
+
+struct MicroResult {
+    std::string name;
+    long long operations;
+    double seconds;
+    double checksum;
+
+    [[nodiscard]] double nsPerOp() const { return seconds * 1e9 / operations; }
+
+    [[nodiscard]] std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"name\": \"" << name << "\", \"ns_per_op\": " << nsPerOp() << ", \"operations\": " << operations
+            << ", \"checksum\": " << checksum << "}";
+        return out.str();
+    }
+};
+
+struct RenderResult {
+    int width;
+    int height;
+    int threads;
+    int samplesPerPixel;
+    long long rays;
+    double seconds;
+
+    [[nodiscard]] double megaraysPerSecond() const { return rays / seconds / 1e6; }
+
+    [[nodiscard]] std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"width\": " << width << ", \"height\": " << height << ", \"threads\": " << threads
+            << ", \"spp\": " << samplesPerPixel << ", \"rays\": " << rays << ", \"seconds\": " << seconds
+            << ", \"mrays_per_s\": " << megaraysPerSecond() << "}";
+        return out.str();
+    }
+};
+
+struct ReprojectionResult {
+    double orbitRadians;
+    double reusedFraction;
+    double reprojectMillis;
+    double rmseReset;      // of one pass after discarding the accumulation, against the reference
+    double rmseReprojected;// of one pass after reprojecting it
+    long long passMillisReset;
+    long long passMillisReprojected;// higher, as disoccluded pixels get extra samples
+
+    [[nodiscard]] std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"orbit_radians\": " << orbitRadians << ", \"reused_fraction\": " << reusedFraction
+            << ", \"reproject_ms\": " << reprojectMillis << ", \"rmse_reset\": " << rmseReset
+            << ", \"rmse_reprojected\": " << rmseReprojected << ", \"pass_ms_reset\": " << passMillisReset
+            << ", \"pass_ms_reprojected\": " << passMillisReprojected << "}";
+        return out.str();
+    }
+};
+
+struct DenoiseResult {
+    int samplesPerPixel;
+    double rmseNoisy;   // against the reference
+    double rmseDenoised;
+    double denoiseMillis;
+    double passMillis;       // mean render time of a pass, for scale
+    std::optional<int> noisySamplesToMatch;// fewest samples per pixel measured whose noisy image is as good, if any
+
+    [[nodiscard]] std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"spp\": " << samplesPerPixel << ", \"rmse_noisy\": " << rmseNoisy << ", \"rmse_denoised\": "
+            << rmseDenoised << ", \"denoise_ms\": " << denoiseMillis << ", \"pass_ms\": " << passMillis
+            << ", \"noisy_spp_to_match\": ";
+        if (noisySamplesToMatch) {
+            out << *noisySamplesToMatch;
+        } else {
+            out << "null";
+        }
+        out << "}";
+        return out.str();
+    }
+};
+
+struct RouletteResult {
+    int maxDepth;
+    bool isRoulette;
+    double raysPerSample;// per pixel sample, counting every segment of the path
+    int samplesPerPixel; // reached within the time budget
+    double seconds;
+    double rmse;// against a reference without depth limit
+
+    [[nodiscard]] std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"max_depth\": " << maxDepth << ", \"roulette\": " << (isRoulette ? "true" : "false")
+            << ", \"rays_per_sample\": " << raysPerSample << ", \"spp\": " << samplesPerPixel
+            << ", \"seconds\": " << seconds << ", \"rmse\": " << rmse << "}";
+        return out.str();
+    }
+};
+
+struct LightSamplingResult {
+    bool isSampled;// next-event estimation towards the lights
+    int samplesPerPixel;
+    double rmse;// against the reference
+    double passMillis;// mean render time of a pass
+
+    [[nodiscard]] std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"sampled\": " << (isSampled ? "true" : "false") << ", \"spp\": " << samplesPerPixel
+            << ", \"rmse\": " << rmse << ", \"pass_ms\": " << passMillis << "}";
+        return out.str();
+    }
+};
+
+struct DispatchResult {
+    bool isClosed;// ClosedScene instead of the virtual Bvh over shared Hittables
+    bool isWavefront;
+    long long rays;
+    double seconds;// fastest of the repetitions
+    bool isIdentical;// image equals the one of the virtual path
+
+    [[nodiscard]] double megaraysPerSecond() const { return rays / seconds / 1e6; }
+
+    [[nodiscard]] std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"closed\": " << (isClosed ? "true" : "false") << ", \"integrator\": \""
+            << (isWavefront ? "wavefront" : "recursive") << "\", \"rays\": " << rays << ", \"seconds\": " << seconds
+            << ", \"mrays_per_s\": " << megaraysPerSecond() << ", \"identical\": " << (isIdentical ? "true" : "false")
+            << "}";
+        return out.str();
+    }
+};
+
+struct ResampleResult {
+    int fromWidth;
+    int fromHeight;
+    int toWidth;
+    int toHeight;
+    double resampleMillis;
+    double rmseReset;    // of one pass after discarding the accumulation, against the reference
+    double rmseResampled;// of one pass after resampling it
+
+    [[nodiscard]] std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"from\": [" << fromWidth << ", " << fromHeight << "], \"to\": [" << toWidth << ", " << toHeight
+            << "], \"resample_ms\": " << resampleMillis << ", \"rmse_reset\": " << rmseReset
+            << ", \"rmse_resampled\": " << rmseResampled << "}";
+        return out.str();
+    }
+};
+
+struct DynamicResolutionResult {
+    double budgetMillis;
+    double scale;        // settled render scale
+    double passMillis;   // median pass time at that scale
+    double fullPassMillis;// median pass time at full resolution, for scale
+    int changes;         // scale changes until settled
+
+    [[nodiscard]] std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"budget_ms\": " << budgetMillis << ", \"scale\": " << scale << ", \"pass_ms\": " << passMillis
+            << ", \"full_pass_ms\": " << fullPassMillis << ", \"changes\": " << changes << "}";
+        return out.str();
+    }
+};
+
+struct PreviewResult {
+    bool isPreview;
+    double latencyTargetMillis;
+    double firstFeedbackMillis;// median time from reset() to the first image
+    double fullResolutionMillis;// median time from reset() to the first full-resolution pass
+    int firstPreviewScale;
+
+    [[nodiscard]] std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"progressive\": " << (isPreview ? "true" : "false") << ", \"latency_target_ms\": " << latencyTargetMillis
+            << ", \"first_feedback_ms\": " << firstFeedbackMillis << ", \"first_scale\": " << firstPreviewScale
+            << ", \"full_resolution_ms\": " << fullResolutionMillis << "}";
+        return out.str();
+    }
+};
+
+/**
+ * The results of one group of benchmarks, one JSON object per result, written under the group's name.
+ */
+struct BenchSection {
+    std::string name;
+    std::vector<std::string> rows;
+};
+
+template<typename Result>
+BenchSection makeSection(std::string name, const std::vector<Result> &results) {
+    BenchSection section{std::move(name), {}};
+    for (const auto &r: results) {
+        section.rows.push_back(r.toJson());
+    }
+    return section;
+}
+
+/**
+ * Runs batch until minSeconds have passed. batch returns the number of operations it performed and adds its
+ * results to the checksum.
+ */
+template<typename Batch>
+MicroResult measure(const std::string &name, double minSeconds, Batch batch) {
+    MicroResult result{name, 0, 0, 0};
+    batch(result.checksum);// warm up caches and branch predictors
+    result.checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        result.operations += batch(result.checksum);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (result.seconds < minSeconds);
+    std::cerr << name << ": " << result.nsPerOp() << " ns/op\n";
+    return result;
+}
+
+/**
+ * Forwards to a scene and counts the rays cast into it. Only used single-threaded.
+ */
+class RayCounter : public Hittable {
+public:
+    explicit RayCounter(const Hittable &scene) : scene(scene) {}
+
+    [[nodiscard]] std::optional<Intersection> intersect(const Ray &r, Real tMin, Real tMax) const override {
+        count++;
+        return scene.intersect(r, tMin, tMax);
+    }
+
+    [[nodiscard]] HitRecord resolve(const Ray &r, const Intersection &intersection) const override {
+        return resolveHit(r, intersection);
+    }
+
+    [[nodiscard]] Aabb boundingBox() const override {
+        return scene.boundingBox();
+    }
+
+    [[nodiscard]] long long getCount() const {
+        return count;
+    }
+
+private:
+    const Hittable &scene;
+    mutable long long count = 0;
+};
+
+std::vector<MicroResult> runMicroBenchmarks(const BenchOptions &options) {
+    const int numRays = 4096;
+    auto world = randomScene();
+    auto camera = randomSceneCamera(16.0 / 9.0);
+
+    Rng rng(1);
+    std::vector<Ray> rays;
+    for (int i = 0; i < numRays; i++) {
+        auto s = static_cast<Real>(randomDouble(rng));
+        auto t = static_cast<Real>(randomDouble(rng));
+        rays.push_back(camera->getRay(s, t, rng));
+    }
+
+    std::vector<std::pair<Ray, HitRecord>> hits;
+    for (const auto &r: rays) {
+        if (auto rec = world->hit(r, 0.001, std::numeric_limits<Real>::infinity())) {
+            hits.emplace_back(r, *rec);
+        }
+    }
+
+    std::vector<const Sphere *> spheres;
+    for (const auto &object: world->objects) {
+        spheres.push_back(dynamic_cast<const Sphere *>(object.get()));
+    }
+
+    const auto infinity = std::numeric_limits<Real>::infinity();
+    std::vector<MicroResult> results;
+
+    results.push_back(measure("sphere_hit", options.minSeconds, [&](double &checksum) {
+        for (int i = 0; i < numRays; i++) {
+            if (auto rec = spheres[i % spheres.size()]->hit(rays[i], 0.001, infinity)) {
+                checksum += rec->t;
+            }
+        }
+        return static_cast<long long>(numRays);
+    }));
+
+    results.push_back(measure("hittable_list_hit", options.minSeconds, [&](double &checksum) {
+        for (const auto &r: rays) {
+            if (auto rec = world->hit(r, 0.001, infinity)) {
+                checksum += rec->t;
+            }
+        }
+        return static_cast<long long>(numRays);
+    }));
+
+    Bvh bvh(*world);
+    results.push_back(measure("bvh_hit", options.minSeconds, [&](double &checksum) {
+        for (const auto &r: rays) {
+            if (auto rec = bvh.hit(r, 0.001, infinity)) {
+                checksum += rec->t;
+            }
+        }
+        return static_cast<long long>(numRays);
+    }));
+
+    SphereSoA soa(*world);
+    results.push_back(measure("sphere_soa_hit", options.minSeconds, [&](double &checksum) {
+        for (const auto &r: rays) {
+            if (auto rec = soa.hit(r, 0.001, infinity)) {
+                checksum += rec->t;
+            }
+        }
+        return static_cast<long long>(numRays);
+    }));
+
+    Lambertian lambertian(Color(0.5, 0.5, 0.5));
+    Metal metal(Color(0.7, 0.6, 0.5), 0.3);
+    Dielectric dielectric(1.5);
+    std::vector<std::pair<std::string, const Material *>> materials = {
+            {"lambertian_scatter", &lambertian},
+            {"metal_scatter", &metal},
+            {"dielectric_scatter", &dielectric}};
+    for (const auto &[name, material]: materials) {
+        results.push_back(measure(name, options.minSeconds, [&, material = material](double &checksum) {
+            Rng scatterRng(2);
+            for (const auto &[r, rec]: hits) {
+                if (auto scattered = material->scatter(r, rec, scatterRng)) {
+                    checksum += scattered->direction().x();
+                }
+            }
+            return static_cast<long long>(hits.size());
+        }));
+    }
+
+    results.push_back(measure("camera_get_ray", options.minSeconds, [&](double &checksum) {
+        Rng rayRng(3);
+        for (int i = 0; i < numRays; i++) {
+            auto r = camera->getRay(static_cast<Real>(i) / numRays, 0.5, rayRng);
+            checksum += r.direction().y();
+        }
+        return static_cast<long long>(numRays);
+    }));
+
+    std::vector<Color> colors;
+    for (int i = 0; i < numRays; i++) {
+        colors.push_back(Color::random(rng));
+    }
+    results.push_back(measure("to_int", options.minSeconds, [&](double &checksum) {
+        int combined = 0;
+        for (const auto &color: colors) {
+            combined ^= toInt(color);
+        }
+        checksum += combined;
+        return static_cast<long long>(colors.size());
+    }));
+
+    return results;
+}
+
+std::vector<RenderResult> runRenderBenchmarks(const BenchOptions &options) {
+    std::vector<std::pair<int, int>> resolutions = {{320, 180}, {640, 360}};
+    if (!options.isQuick) {
+        resolutions.emplace_back(1280, 720);
+    }
+    std::vector<int> threadCounts = {1};
+    int hardwareThreads = static_cast<int>(std::thread::hardware_concurrency());
+    if (hardwareThreads > 1) {
+        threadCounts.push_back(hardwareThreads);
+    }
+
+    auto world = randomScene();
+    Bvh bvh(*world);
+    std::vector<RenderResult> results;
+
+    for (auto [width, height]: resolutions) {
+        auto camera = randomSceneCamera(static_cast<Real>(width) / height);
+
+        // Rendering is deterministic for a fixed seed, so one counted single-threaded pass gives the ray count of all runs.
+        RayCounter counter(bvh);
+        Renderer countingRenderer(width, height, 5, 0, 1);
+        for (int pass = 0; pass < options.samplesPerPixel; pass++) {
+            countingRenderer.render(*camera, counter);
+        }
+
+        for (int threads: threadCounts) {
+            Renderer renderer(width, height, 5, 0, threads);
+            auto start = std::chrono::steady_clock::now();
+            for (int pass = 0; pass < options.samplesPerPixel; pass++) {
+                renderer.render(*camera, bvh);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            RenderResult result{width, height, threads, options.samplesPerPixel, counter.getCount(), seconds};
+            std::cerr << "render " << width << "x" << height << " on " << threads << " threads: "
+                      << result.megaraysPerSecond() << " Mrays/s\n";
+            results.push_back(result);
+        }
+    }
+    return results;
+}
+
+/**
+ * Time to the first image after a reset at the GUI's resolution, with and without progressive preview.
+ */
+std::vector<PreviewResult> runPreviewBenchmarks(const BenchOptions &options) {
+    const int width = 600;
+    const int height = 400;
+    const int trials = options.isQuick ? 3 : 9;
+    auto world = randomScene();
+    Bvh bvh(*world);
+    auto camera = randomSceneCamera(static_cast<Real>(width) / height);
+
+    std::vector<PreviewResult> results;
+    for (bool isPreview: {false, true}) {
+        Renderer renderer(width, height, 5);
+        renderer.setProgressivePreview(isPreview);
+        renderer.render(*camera, bvh);// measures the cost of a sample for the first preview level
+
+        std::vector<double> firstFeedback;
+        std::vector<double> fullResolution;
+        int firstScale = 1;
+        for (int trial = 0; trial < trials; trial++) {
+            auto start = std::chrono::steady_clock::now();
+            renderer.reset();
+            auto img = renderer.render(*camera, bvh);
+            firstFeedback.push_back(renderer.getFeedbackLatencyMillis());
+            firstScale = img->previewScale;
+            while (img->previewScale > 1) {
+                img = renderer.render(*camera, bvh);
+            }
+            fullResolution.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(firstFeedback.begin(), firstFeedback.end());
+        std::sort(fullResolution.begin(), fullResolution.end());
+
+        PreviewResult result{isPreview, renderer.getPreviewLatencyTarget(), firstFeedback[trials / 2], fullResolution[trials / 2], firstScale};
+        std::cerr << "first image after reset " << (isPreview ? "with" : "without") << " preview: "
+                  << result.firstFeedbackMillis << " ms (1/" << firstScale << " resolution), full resolution after "
+                  << result.fullResolutionMillis << " ms\n";
+        results.push_back(result);
+    }
+    return results;
+}
+
+/**
+ * Error of the first pass after a camera orbit, when the accumulation is discarded and when it is reprojected.
+ */
+std::vector<ReprojectionResult> runReprojectionBenchmarks(const BenchOptions &options) {
+    const int width = 320;
+    const int height = 180;
+    const int historyPasses = options.isQuick ? 8 : 32;
+    const int referencePasses = options.isQuick ? 32 : 256;
+    auto world = randomScene();
+    Bvh bvh(*world);
+    auto camera = randomSceneCamera(static_cast<Real>(width) / height);
+    auto pixels = [](const Image &img) { return std::vector<int>(img.data, img.data + img.width * img.height); };
+
+    std::vector<ReprojectionResult> results;
+    for (double orbitRadians: {0.01, 0.05}) {
+        Camera moved(*camera);
+        moved.orbit(static_cast<Real>(orbitRadians), 0);
+
+        Renderer reference(width, height, 5, 1);// another seed, so its noise is independent of the renders compared
+        std::shared_ptr<Image> referenceImage;
+        for (int pass = 0; pass < referencePasses; pass++) {
+            referenceImage = reference.render(moved, bvh);
+        }
+
+        Renderer renderer(width, height, 5);
+        renderer.setDepthTracking(true);
+        for (int pass = 0; pass < historyPasses; pass++) {
+            renderer.render(*camera, bvh);
+        }
+        auto start = std::chrono::steady_clock::now();
+        renderer.reproject(*camera, moved);
+        double reprojectMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        auto reprojected = renderer.render(moved, bvh);
+
+        renderer.reset();
+        auto fresh = renderer.render(moved, bvh);
+
+        ReprojectionResult result{orbitRadians, renderer.getReprojectedFraction(), reprojectMillis,
+                                  compareImages(pixels(*referenceImage), pixels(*fresh)).rmse,
+                                  compareImages(pixels(*referenceImage), pixels(*reprojected)).rmse,
+                                  fresh->cumulativeRenderTime.count(), reprojected->cumulativeRenderTime.count()};
+        std::cerr << "orbit by " << orbitRadians << " rad: " << 100 * result.reusedFraction << "% of pixels reprojected in "
+                  << reprojectMillis << " ms, RMSE after one pass " << result.rmseReprojected << " in "
+                  << result.passMillisReprojected << " ms (discarded: " << result.rmseReset << " in " << result.passMillisReset << " ms)\n";
+        results.push_back(result);
+    }
+    return results;
+}
+
+/**
+ * Error of the accumulated image against a reference after increasing numbers of samples, with and without the
+ * denoiser.
+ */
+std::vector<DenoiseResult> runDenoiseBenchmarks(const BenchOptions &options) {
+    const int width = 320;
+    const int height = 180;
+    const int referencePasses = options.isQuick ? 32 : 256;
+    const std::vector<int> levels = options.isQuick ? std::vector<int>{1, 2, 4, 8} : std::vector<int>{1, 2, 4, 8, 16, 32, 64};
+    auto world = randomScene();
+    Bvh bvh(*world);
+    auto camera = randomSceneCamera(static_cast<Real>(width) / height);
+    auto pixels = [](const Image &img) { return std::vector<int>(img.data, img.data + img.width * img.height); };
+
+    Renderer reference(width, height, 5, 1);// another seed, so its noise is independent of the renders compared
+    std::shared_ptr<Image> referenceImage;
+    for (int pass = 0; pass < referencePasses; pass++) {
+        referenceImage = reference.render(*camera, bvh);
+    }
+    auto referencePixels = pixels(*referenceImage);
+
+    std::vector<DenoiseResult> results;
+    Renderer renderer(width, height, 5);
+    renderer.setFeatureTracking(true);
+    for (int samples: levels) {
+        std::shared_ptr<Image> img;
+        while (renderer.getSamplesAccumulated() < samples) {
+            img = renderer.render(*camera, bvh);
+        }
+        renderer.setDenoising(true);
+        auto denoised = renderer.accumulatedImage();
+        renderer.setDenoising(false);
+        results.push_back({samples, compareImages(referencePixels, pixels(*img)).rmse,
+                           compareImages(referencePixels, pixels(*denoised)).rmse, denoised->denoiseMillis,
+                           static_cast<double>(img->cumulativeRenderTime.count()) / samples, std::nullopt});
+    }
+    for (auto &result: results) {
+        for (const auto &noisy: results) {
+            if (noisy.rmseNoisy <= result.rmseDenoised) {
+                result.noisySamplesToMatch = noisy.samplesPerPixel;
+                break;
+            }
+        }
+        std::cerr << "denoise at " << result.samplesPerPixel << " spp: RMSE " << result.rmseNoisy << " -> "
+                  << result.rmseDenoised << " in " << result.denoiseMillis << " ms (pass " << result.passMillis
+                  << " ms), noisy image as good at ";
+        if (result.noisySamplesToMatch) {
+            std::cerr << *result.noisySamplesToMatch << " spp\n";
+        } else {
+            std::cerr << "more than " << levels.back() << " spp\n";
+        }
+    }
+    return results;
+}
+
+/**
+ * Rays per sample and error at equal render time for a few maximum depths, with and without Russian roulette. The
+ * reference has a depth limit high enough to be unreachable in practice, so the error of low limits includes the
+ * energy they cut off.
+ */
+std::vector<RouletteResult> runRouletteBenchmarks(const BenchOptions &options) {
+    const int width = 320;
+    const int height = 180;
+    const int referencePasses = options.isQuick ? 32 : 256;
+    const int referenceDepth = 100;
+    const double secondsPerRun = options.isQuick ? 1 : 4;
+    const std::vector<std::pair<int, bool>> configurations = {{5, false}, {16, false}, {16, true}, {50, true}};
+    auto world = randomScene();
+    Bvh bvh(*world);
+    auto camera = randomSceneCamera(static_cast<Real>(width) / height);
+    auto pixels = [](const Image &img) { return std::vector<int>(img.data, img.data + img.width * img.height); };
+
+    Renderer reference(width, height, referenceDepth, 1);
+    reference.setRussianRoulette(true);// unbiased, and much faster at this depth
+    std::shared_ptr<Image> referenceImage;
+    for (int pass = 0; pass < referencePasses; pass++) {
+        referenceImage = reference.render(*camera, bvh);
+    }
+    auto referencePixels = pixels(*referenceImage);
+
+    std::vector<RouletteResult> results;
+    for (auto [maxDepth, isRoulette]: configurations) {
+        const int countedPasses = 2;
+        RayCounter counter(bvh);
+        Renderer countingRenderer(width, height, maxDepth, 0, 1);
+        countingRenderer.setRussianRoulette(isRoulette);
+        for (int pass = 0; pass < countedPasses; pass++) {
+            countingRenderer.render(*camera, counter);
+        }
+
+        Renderer renderer(width, height, maxDepth);
+        renderer.setRussianRoulette(isRoulette);
+        std::shared_ptr<Image> img;
+        auto start = std::chrono::steady_clock::now();
+        double seconds = 0;
+        while (seconds < secondsPerRun) {
+            img = renderer.render(*camera, bvh);
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        RouletteResult result{maxDepth, isRoulette, static_cast<double>(counter.getCount()) / (countedPasses * width * height),
+                              renderer.getSamplesAccumulated(), seconds, compareImages(referencePixels, pixels(*img)).rmse};
+        std::cerr << "roulette " << (isRoulette ? "on" : "off") << " at max depth " << maxDepth << ": "
+                  << result.raysPerSample << " rays/sample, " << result.samplesPerPixel << " spp in " << seconds
+                  << " s, RMSE " << result.rmse << "\n";
+        results.push_back(result);
+    }
+    return results;
+}
+
+/**
+ * Error of smallLightScene() against a reference after increasing numbers of samples, with the lights sampled
+ * directly and with scattered rays alone.
+ */
+std::vector<LightSamplingResult> runLightSamplingBenchmarks(const BenchOptions &options) {
+    const int width = 320;
+    const int height = 180;
+    const int referencePasses = options.isQuick ? 64 : 512;
+    const std::vector<int> levels = options.isQuick ? std::vector<int>{4, 16, 64} : std::vector<int>{4, 16, 64, 256};
+    auto scene = smallLightScene();
+    Bvh bvh(*scene.world);
+    auto camera = scene.camera.build(static_cast<Real>(width) / height);
+    auto pixels = [](const Image &img) { return std::vector<int>(img.data, img.data + img.width * img.height); };
+    Lights sampledLights(*scene.world, scene.hasSky);
+    Lights unsampledLights(HittableList(), scene.hasSky);
+
+    Renderer reference(width, height, 5, 1);
+    reference.setLights(sampledLights);
+    std::shared_ptr<Image> referenceImage;
+    for (int pass = 0; pass < referencePasses; pass++) {
+        referenceImage = reference.render(*camera, bvh);
+    }
+    auto referencePixels = pixels(*referenceImage);
+
+    std::vector<LightSamplingResult> results;
+    for (bool isSampled: {false, true}) {
+        Renderer renderer(width, height, 5);
+        renderer.setLights(isSampled ? sampledLights : unsampledLights);
+        for (int samples: levels) {
+            std::shared_ptr<Image> img;
+            while (renderer.getSamplesAccumulated() < samples) {
+                img = renderer.render(*camera, bvh);
+            }
+            LightSamplingResult result{isSampled, samples, compareImages(referencePixels, pixels(*img)).rmse,
+                                       static_cast<double>(img->cumulativeRenderTime.count()) / samples};
+            std::cerr << "small lights " << (isSampled ? "sampled" : "not sampled") << " at " << samples << " spp: RMSE "
+                      << result.rmse << ", " << result.passMillis << " ms per pass\n";
+            results.push_back(result);
+        }
+    }
+    return results;
+}
+
+/**
+ * Error of the first pass after a change of resolution, when the accumulation is discarded and when it is
+ * resampled, against a reference at the new resolution.
+ */
+std::vector<ResampleResult> runResampleBenchmarks(const BenchOptions &options) {
+    const int historyPasses = options.isQuick ? 8 : 32;
+    const int referencePasses = options.isQuick ? 32 : 256;
+    const std::vector<std::pair<std::pair<int, int>, std::pair<int, int>>> changes = {{{160, 90}, {320, 180}},
+                                                                                      {{240, 135}, {320, 180}},
+                                                                                      {{320, 180}, {160, 90}}};
+    auto world = randomScene();
+    Bvh bvh(*world);
+    auto camera = randomSceneCamera(Real(16) / 9);
+    auto pixels = [](const Image &img) { return std::vector<int>(img.data, img.data + img.width * img.height); };
+
+    std::vector<ResampleResult> results;
+    for (auto [from, to]: changes) {
+        Renderer reference(to.first, to.second, 5, 1);// another seed, so its noise is independent of the renders compared
+        std::shared_ptr<Image> referenceImage;
+        for (int pass = 0; pass < referencePasses; pass++) {
+            referenceImage = reference.render(*camera, bvh);
+        }
+
+        Renderer renderer(from.first, from.second, 5);
+        for (int pass = 0; pass < historyPasses; pass++) {
+            renderer.render(*camera, bvh);
+        }
+        auto start = std::chrono::steady_clock::now();
+        renderer.resize(to.first, to.second);
+        double resampleMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        auto resampled = renderer.render(*camera, bvh);
+
+        renderer.reset();
+        auto fresh = renderer.render(*camera, bvh);
+
+        ResampleResult result{from.first, from.second, to.first, to.second, resampleMillis,
+                              compareImages(pixels(*referenceImage), pixels(*fresh)).rmse,
+                              compareImages(pixels(*referenceImage), pixels(*resampled)).rmse};
+        std::cerr << "resize " << from.first << "x" << from.second << " to " << to.first << "x" << to.second << ": resampled in "
+                  << resampleMillis << " ms, RMSE after one pass " << result.rmseResampled << " (discarded: "
+                  << result.rmseReset << ")\n";
+        results.push_back(result);
+    }
+    return results;
+}
+
+/**
+ * Render scale that DynamicResolution settles on for a window of the GUI's default size, and the pass time it
+ * reaches, for frame budgets around the cost of a full pass.
+ */
+std::vector<DynamicResolutionResult> runDynamicResolutionBenchmarks(const BenchOptions &options) {
+    const int windowWidth = 640;
+    const int windowHeight = 360;
+    const int passes = options.isQuick ? 8 : 16;
+    auto world = randomScene();
+    Bvh bvh(*world);
+    auto camera = randomSceneCamera(static_cast<Real>(windowWidth) / windowHeight);
+    auto median = [](std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    };
+    auto timePass = [&](Renderer &renderer) {
+        auto start = std::chrono::steady_clock::now();
+        renderer.render(*camera, bvh);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    Renderer fullRenderer(windowWidth, windowHeight, 5);
+    std::vector<double> fullTimes;
+    for (int pass = 0; pass < 3; pass++) {
+        fullTimes.push_back(timePass(fullRenderer));
+    }
+    double fullPassMillis = median(fullTimes);
+
+    std::vector<DynamicResolutionResult> results;
+    for (double fraction: {0.1, 0.25, 0.5}) {
+        DynamicResolution controller(fullPassMillis * fraction);
+        Renderer renderer(windowWidth, windowHeight, 5);
+        int changes = 0;
+        std::vector<double> times;
+        for (int pass = 0; pass < passes; pass++) {
+            double millis = timePass(renderer);
+            times.push_back(millis);
+            if (controller.update(millis)) {
+                auto [width, height] = controller.renderSize(windowWidth, windowHeight);
+                renderer.resize(width, height);
+                times.clear();
+                changes++;
+            }
+        }
+
+        DynamicResolutionResult result{controller.getBudget(), controller.getScale(), times.empty() ? 0 : median(times),
+                                       fullPassMillis, changes};
+        std::cerr << "dynamic resolution with a " << result.budgetMillis << " ms budget: scale " << result.scale << " after "
+                  << changes << " changes, " << result.passMillis << " ms per pass (full resolution: " << fullPassMillis << " ms)\n";
+        results.push_back(result);
+    }
+    return results;
+}
+
+/**
+ * Single-threaded throughput on randomScene() of the closed scene, which calls primitives and materials through
+ * their concrete types, against the virtual path, for both integrators.
+ */
+std::vector<DispatchResult> runDispatchBenchmarks(const BenchOptions &options) {
+    const int width = 320;
+    const int height = 180;
+    const int repetitions = options.isQuick ? 1 : 3;
+    auto world = randomScene();
+    Bvh bvh(*world);
+    ClosedScene closedScene(*world);
+    auto camera = randomSceneCamera(static_cast<Real>(width) / height);
+    auto pixels = [](const Image &img) { return std::vector<int>(img.data, img.data + img.width * img.height); };
+
+    RayCounter counter(bvh);
+    Renderer countingRenderer(width, height, 5, 0, 1);
+    for (int pass = 0; pass < options.samplesPerPixel; pass++) {
+        countingRenderer.render(*camera, counter);
+    }
+
+    std::vector<DispatchResult> results;
+    for (bool isWavefront: {false, true}) {
+        std::vector<int> virtualPixels;
+        for (bool isClosed: {false, true}) {
+            const Hittable &scene = isClosed ? static_cast<const Hittable &>(closedScene) : bvh;
+            double seconds = std::numeric_limits<double>::infinity();
+            std::shared_ptr<Image> img;
+            for (int repetition = 0; repetition < repetitions; repetition++) {
+                Renderer renderer(width, height, 5, 0, 1);
+                renderer.setIntegrator(isWavefront ? Integrator::Wavefront : Integrator::Recursive);
+                auto start = std::chrono::steady_clock::now();
+                for (int pass = 0; pass < options.samplesPerPixel; pass++) {
+                    img = renderer.render(*camera, scene);
+                }
+                seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+            if (!isClosed) {
+                virtualPixels = pixels(*img);
+            }
+
+            DispatchResult result{isClosed, isWavefront, counter.getCount(), seconds, pixels(*img) == virtualPixels};
+            std::cerr << "dispatch " << (isClosed ? "closed" : "virtual") << " with the "
+                      << (isWavefront ? "wavefront" : "recursive") << " integrator: " << result.megaraysPerSecond()
+                      << " Mrays/s" << (result.isIdentical ? "" : ", image differs") << "\n";
+            results.push_back(result);
+        }
+    }
+    return results;
+}
+
+void writeJson(std::ostream &out, const std::vector<BenchSection> &sections) {
+    out << "{\n"
+        << "  \"precision\": \"" << (sizeof(Real) == sizeof(float) ? "float" : "double") << "\",\n"
+        << "  \"hardware_threads\": " << std::thread::hardware_concurrency();
+    for (const auto &section: sections) {
+        out << ",\n"
+            << "  \"" << section.name << "\": [\n";
+        for (size_t i = 0; i < section.rows.size(); i++) {
+            out << "    " << section.rows[i] << (i + 1 < section.rows.size() ? "," : "") << "\n";
+        }
+        out << "  ]";
+    }
+    out << "\n"
+        << "}\n";
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--quick") {
+            options.isQuick = true;
+            options.minSeconds = 0.05;
+            options.samplesPerPixel = 1;
+        } else if ((arg == "--output" || arg == "-o") && i + 1 < argc) {
+            options.outputPath = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--quick] [--output <path.json>]\n";
+            return 1;
+        }
+    }
+
+    // Run in this order; a new group of benchmarks only needs its entry here.
+    std::vector<BenchSection> sections = {
+            makeSection("micro", runMicroBenchmarks(options)),
+            makeSection("render", runRenderBenchmarks(options)),
+            makeSection("preview", runPreviewBenchmarks(options)),
+            makeSection("reprojection", runReprojectionBenchmarks(options)),
+            makeSection("denoise", runDenoiseBenchmarks(options)),
+            makeSection("roulette", runRouletteBenchmarks(options)),
+            makeSection("light_sampling", runLightSamplingBenchmarks(options)),
+            makeSection("dispatch", runDispatchBenchmarks(options)),
+            makeSection("resample", runResampleBenchmarks(options)),
+            makeSection("dynamic_resolution", runDynamicResolutionBenchmarks(options)),
+    };
+
+    if (options.outputPath.empty()) {
+        writeJson(std::cout, sections);
+        return 0;
+    }
+    std::ofstream out(options.outputPath);
+    writeJson(out, sections);
+    if (!out) {
+        std::cerr << "Failed to write " << options.outputPath << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,333 @@
+#ifndef RAYTRACER_BVH_H
+#define RAYTRACER_BVH_H
+
+#include "aabb.h"
+#include "hit_record.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include <array>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+/**
+ * A node of a flattened BVH. Nodes are stored in depth-first order, so the first child of an interior node
+ * is always the node directly after it and only the index of the second child needs to be stored.
+ */
+struct BvhNode {
+    Aabb bounds;
+    int offset;// leaf: index of the first primitive, interior: index of the second child
+    int count; // number of primitives in a leaf, 0 for interior nodes
+    int axis;  // split axis of an interior node
+
+    [[nodiscard]] bool isLeaf() const { return count > 0; }
+};
+
+/**
+ * Builds a flattened BVH over a set of primitive bounding boxes using a binned surface area heuristic.
+ * The builder only sees boxes, so it can be shared by any container that needs a hierarchy over its primitives.
+ */
+class BvhBuilder {
+public:
+    struct Result {
+        std::vector<BvhNode> nodes;
+        std::vector<int> primitiveIndices;// primitive order referenced by the leaves
+    };
+
+    static constexpr int maxDepth = 64;
+
+    explicit BvhBuilder(int maxLeafSize = 4) : maxLeafSize(maxLeafSize) {}
+
+    [[nodiscard]] Result build(const std::vector<Aabb> &primitiveBounds) const {
+        Result result;
+        if (primitiveBounds.empty()) {
+            return result;
+        }
+
+        std::vector<BuildPrimitive> prims(primitiveBounds.size());
+        for (int i = 0; i < static_cast<int>(prims.size()); i++) {
+            prims[i] = {primitiveBounds[i], primitiveBounds[i].centroid(), i};
+        }
+
+        result.nodes.reserve(2 * prims.size());
+        buildRecursive(prims, 0, static_cast<int>(prims.size()), result.nodes, 0);
+
+        result.primitiveIndices.resize(prims.size());
+        for (int i = 0; i < static_cast<int>(prims.size()); i++) {
+            result.primitiveIndices[i] = prims[i].index;
+        }
+        result.nodes.shrink_to_fit();
+        return result;
+    }
+
+private:
+    // Below this depth the tree is split at the median, which keeps the total depth within maxDepth for up to 2^32 primitives.
+    static constexpr int maxSahDepth = 32;
+    static constexpr int numBins = 16;
+    static constexpr double traversalCost = 1.0;
+    static constexpr double intersectionCost = 1.0;
+
+    struct BuildPrimitive {
+        Aabb bounds;
+        Point3 centroid;
+        int index;
+    };
+
+    struct Bin {
+        Aabb bounds;
+        int count = 0;
+    };
+
+    int maxLeafSize;
+
+    int buildRecursive(std::vector<BuildPrimitive> &prims, int begin, int end, std::vector<BvhNode> &nodes, int depth) const {
+        int nodeIndex = static_cast<int>(nodes.size());
+        nodes.push_back({});
+
+        Aabb bounds;
+        Aabb centroidBounds;
+        for (int i = begin; i < end; i++) {
+            bounds.expand(prims[i].bounds);
+            centroidBounds.expand(prims[i].centroid);
+        }
+
+        int count = end - begin;
+        int axis = centroidBounds.longestAxis();
+        double axisMin = centroidBounds.min()[axis];
+        double axisExtent = centroidBounds.max()[axis] - axisMin;
+
+        auto makeLeaf = [&]() {
+            nodes[nodeIndex] = {bounds, begin, count, 0};
+            return nodeIndex;
+        };
+
+        if (count == 1 || (axisExtent <= 0 && count <= maxLeafSize)) {
+            return makeLeaf();
+        }
+        if (axisExtent <= 0 || depth >= maxSahDepth) {
+            return splitMiddle(prims, begin, end, nodes, nodeIndex, bounds, axis, depth);
+        }
+
+        std::array<Bin, numBins> bins;
+        auto binOf = [&](const BuildPrimitive &p) {
+            int b = static_cast<int>(numBins * ((p.centroid[axis] - axisMin) / axisExtent));
+            return std::clamp(b, 0, numBins - 1);
+        };
+        for (int i = begin; i < end; i++) {
+            auto &bin = bins[binOf(prims[i])];
+            bin.count++;
+            bin.bounds.expand(prims[i].bounds);
+        }
+
+        // Sweep from both ends to evaluate the SAH cost of splitting after every bin.
+        std::array<double, numBins - 1> costs{};
+        Aabb leftBounds;
+        int leftCount = 0;
+        for (int i = 0; i < numBins - 1; i++) {
+            leftBounds.expand(bins[i].bounds);
+            leftCount += bins[i].count;
+            costs[i] = leftCount * leftBounds.surfaceArea();
+        }
+        Aabb rightBounds;
+        int rightCount = 0;
+        for (int i = numBins - 1; i > 0; i--) {
+            rightBounds.expand(bins[i].bounds);
+            rightCount += bins[i].count;
+            costs[i - 1] += rightCount * rightBounds.surfaceArea();
+        }
+
+        int bestSplit = static_cast<int>(std::min_element(costs.begin(), costs.end()) - costs.begin());
+        double splitCost = traversalCost + intersectionCost * costs[bestSplit] / bounds.surfaceArea();
+        double leafCost = intersectionCost * count;
+
+        if (count <= maxLeafSize && leafCost <= splitCost) {
+            return makeLeaf();
+        }
+
+        auto mid = std::partition(prims.begin() + begin, prims.begin() + end,
+                                  [&](const BuildPrimitive &p) { return binOf(p) <= bestSplit; });
+        int midIndex = static_cast<int>(mid - prims.begin());
+        if (midIndex == begin || midIndex == end) {
+            return splitMiddle(prims, begin, end, nodes, nodeIndex, bounds, axis, depth);
+        }
+
+        buildRecursive(prims, begin, midIndex, nodes, depth + 1);
+        int secondChild = buildRecursive(prims, midIndex, end, nodes, depth + 1);
+        nodes[nodeIndex] = {bounds, secondChild, 0, axis};
+        return nodeIndex;
+    }
+
+    /**
+     * Median split, used when the SAH cannot separate the primitives (e.g. all centroids coincide) or the tree gets too deep.
+     */
+    int splitMiddle(std::vector<BuildPrimitive> &prims, int begin, int end, std::vector<BvhNode> &nodes,
+                    int nodeIndex, const Aabb &bounds, int axis, int depth) const {
+        int midIndex = begin + (end - begin) / 2;
+        std::nth_element(prims.begin() + begin, prims.begin() + midIndex, prims.begin() + end,
+                         [axis](const BuildPrimitive &a, const BuildPrimitive &b) { return a.centroid[axis] < b.centroid[axis]; });
+        buildRecursive(prims, begin, midIndex, nodes, depth + 1);
+        int secondChild = buildRecursive(prims, midIndex, end, nodes, depth + 1);
+        nodes[nodeIndex] = {bounds, secondChild, 0, axis};
+        return nodeIndex;
+    }
+};
+
+struct BvhTraversalStats {
+    long long rays = 0;
+    long long nodesVisited = 0;
+    long long primitiveTests = 0;
+
+    [[nodiscard]] double nodesPerRay() const { return rays > 0 ? static_cast<double>(nodesVisited) / rays : 0; }
+
+    [[nodiscard]] double primitiveTestsPerRay() const { return rays > 0 ? static_cast<double>(primitiveTests) / rays : 0; }
+};
+
+/**
+ * Finds the closest hit in a flattened BVH, visiting the near child first. intersectPrimitive(i, tMax) tests the
+ * primitive at leaf position i against [tMin, tMax]; every hit shrinks tMax for the rest of the traversal.
+ */
+template<typename IntersectPrimitive>
+std::optional<Intersection> traverseBvh(const std::vector<BvhNode> &nodes, const Ray &r, Real tMin, Real tMax,
+                                        IntersectPrimitive &&intersectPrimitive, BvhTraversalStats *stats = nullptr) {
+    std::optional<Intersection> result;
+    if (nodes.empty()) {
+        return result;
+    }
+
+    auto dir = r.direction();
+    Vec3 invDir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+    std::array<bool, 3> dirIsNeg = {invDir.x() < 0, invDir.y() < 0, invDir.z() < 0};
+
+    std::array<int, BvhBuilder::maxDepth> stack;
+    int stackSize = 0;
+    int current = 0;
+    auto nearestHitDist = tMax;
+
+    if (stats) {
+        stats->rays++;
+    }
+
+    while (true) {
+        const auto &node = nodes[current];
+        if (stats) {
+            stats->nodesVisited++;
+        }
+
+        if (node.bounds.hit(r, invDir, tMin, nearestHitDist)) {
+            if (node.isLeaf()) {
+                for (int i = node.offset; i < node.offset + node.count; i++) {
+                    if (stats) {
+                        stats->primitiveTests++;
+                    }
+                    if (auto intersection = intersectPrimitive(i, nearestHitDist)) {
+                        nearestHitDist = intersection->t;
+                        result = intersection;
+                    }
+                }
+            } else {
+                // Visit the child on the near side of the split plane first.
+                if (dirIsNeg[node.axis]) {
+                    stack[stackSize++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stackSize++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stackSize == 0) {
+            break;
+        }
+        current = stack[--stackSize];
+    }
+
+    return result;
+}
+
+/**
+ * Bounding volume hierarchy over the objects of a HittableList.
+ */
+class Bvh : public Hittable {
+public:
+    using TraversalStats = BvhTraversalStats;
+
+    explicit Bvh(const HittableList &list, int maxLeafSize = 4) {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        std::vector<Aabb> bounds;
+        bounds.reserve(list.objects.size());
+        for (const auto &object: list.objects) {
+            bounds.push_back(object->boundingBox());
+        }
+
+        assign(list, BvhBuilder(maxLeafSize).build(bounds));
+
+        auto end = std::chrono::high_resolution_clock::now();
+        buildTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    }
+
+    /**
+     * Adopts a hierarchy built earlier over the same list, e.g. one loaded from a scene cache.
+     */
+    Bvh(const HittableList &list, BvhBuilder::Result prebuilt) {
+        assign(list, std::move(prebuilt));
+    }
+
+    [[nodiscard]] std::optional<Intersection> intersect(const Ray &r, Real tMin, Real tMax) const override {
+        return traverse(r, tMin, tMax, nullptr);
+    }
+
+    [[nodiscard]] HitRecord resolve(const Ray &r, const Intersection &intersection) const override {
+        return resolveHit(r, intersection);
+    }
+
+    [[nodiscard]] Aabb boundingBox() const override {
+        return nodes.empty() ? Aabb() : nodes[0].bounds;
+    }
+
+    /**
+     * Traces the given rays while counting visited nodes and primitive tests.
+     */
+    [[nodiscard]] TraversalStats measureTraversal(const std::vector<Ray> &rays, Real tMin, Real tMax) const {
+        TraversalStats stats;
+        for (const auto &r: rays) {
+            static_cast<void>(traverse(r, tMin, tMax, &stats));
+        }
+        return stats;
+    }
+
+    [[nodiscard]] std::chrono::microseconds getBuildTime() const {
+        return buildTime;
+    }
+
+    [[nodiscard]] int getNodeCount() const {
+        return static_cast<int>(nodes.size());
+    }
+
+    [[nodiscard]] int getPrimitiveCount() const {
+        return static_cast<int>(primitives.size());
+    }
+
+private:
+    std::vector<BvhNode> nodes;
+    std::vector<shared_ptr<Hittable>> primitives;
+    std::chrono::microseconds buildTime{0};
+
+    void assign(const HittableList &list, BvhBuilder::Result result) {
+        nodes = std::move(result.nodes);
+        primitives.reserve(result.primitiveIndices.size());
+        for (int index: result.primitiveIndices) {
+            primitives.push_back(list.objects[index]);
+        }
+    }
+
+    std::optional<Intersection> traverse(const Ray &r, Real tMin, Real tMax, TraversalStats *stats) const {
+        return traverseBvh(nodes, r, tMin, tMax, [&](int i, Real nearestHitDist) {
+            return primitives[i]->intersect(r, tMin, nearestHitDist);
+        }, stats);
+    }
+};
+
+#endif//RAYTRACER_BVH_H
@@ -4,59 +4,173 @@
 #include "ray.h"
 #include "vec3.h"
 #include <atomic>
+#include <cmath>
+#include <optional>
 
-class Camera {
+template<typename T>
+class CameraT {
 public:
+    /**
+     * Screen position of a point as seen from the centre of the lens.
+     */
+    struct Projection {
+        T s;
+        T t;
+        T depth;// ray parameter of the point along getPinholeRay(s, t)
+    };
+
     /**
      *
      * @param vFov vertical field of view in radians.
      * @param focusDist distance between focus plane and projection point
      */
-    Camera(const Point3 &origin, const Vec3 &lookDir, double roll, double vFov,
-           double aspectRatio, double aperture, double focusDist) : origin(origin), lensRadius(aperture / 2) {
-        auto viewportHeight = 2 * focusDist * tan(vFov / 2);
-        auto viewportWidth = aspectRatio * viewportHeight;
-
-        auto vup = Vec3(-sin(roll), cos(roll), 0);
-        auto unitLookDir = unitVector(lookDir);
-        unitHorizontal = unitVector(cross(vup, -unitLookDir));
-        unitVertical = cross(-unitLookDir, unitHorizontal);
+    CameraT(const Vec3T<T> &origin, const Vec3T<T> &lookDir, T roll, T vFov,
+            T aspectRatio, T aperture, T focusDist) : origin(origin), unitLookDir(unitVector(lookDir)), roll(roll), vFov(vFov),
+                                                      aspectRatio(aspectRatio), focusDist(focusDist), lensRadius(aperture / 2) {
+        updateView();
+    }
 
-        horizontal = viewportWidth * unitHorizontal;
-        vertical = viewportHeight * unitVertical;
-        lowerLeftCorner = origin - horizontal / 2 - vertical / 2 + unitLookDir * focusDist;
+    CameraT(const CameraT &other)
+        : origin(other.origin), unitLookDir(other.unitLookDir), roll(other.roll), vFov(other.vFov), aspectRatio(other.aspectRatio),
+          focusDist(other.focusDist), lensRadius(other.lensRadius.load()) {
+        updateView();
     }
 
-    [[nodiscard]] Ray getRay(double s, double t) const {
-        Vec3 rd = lensRadius * randomInUnitDisk();
-        Vec3 offset = unitHorizontal * rd.x() + unitVertical * rd.y();
+    [[nodiscard]] RayT<T> getRay(T s, T t, Rng &rng) const {
+        Vec3T<T> rd = lensRadius * Vec3T<T>(randomInUnitDisk(rng));
+        Vec3T<T> offset = unitHorizontal * rd.x() + unitVertical * rd.y();
         return {origin + offset, lowerLeftCorner + s * horizontal + t * vertical - origin - offset};
     }
 
-    [[nodiscard]] const Point3 &getOrigin() const {
+    /**
+     * Ray through the centre of the lens, which reaches the focus plane at parameter 1.
+     */
+    [[nodiscard]] RayT<T> getPinholeRay(T s, T t) const {
+        return {origin, lowerLeftCorner + s * horizontal + t * vertical - origin};
+    }
+
+    /**
+     * Inverse of getPinholeRay(): where the point p appears on screen. Returns nothing for points not in front of
+     * the camera; s and t fall outside [0, 1] for points outside the field of view.
+     */
+    [[nodiscard]] std::optional<Projection> project(const Vec3T<T> &p) const {
+        return projectDirection(p - origin);
+    }
+
+    /**
+     * Like project(), for the point at the end of direction d from the centre of the lens.
+     */
+    [[nodiscard]] std::optional<Projection> projectDirection(const Vec3T<T> &d) const {
+        T depth = dot(d, unitLookDir) / focusDist;
+        if (depth <= 0) {
+            return {};
+        }
+        auto onPlane = origin + d / depth - lowerLeftCorner;
+        return Projection{dot(onPlane, horizontal) / horizontal.lengthSquared(), dot(onPlane, vertical) / vertical.lengthSquared(), depth};
+    }
+
+    [[nodiscard]] const Vec3T<T> &getOrigin() const {
         return origin;
     }
 
-    void setOrigin(const Point3 &point) {
+    void setOrigin(const Vec3T<T> &point) {
         origin = point;
+        updateView();
+    }
+
+    /**
+     * Rotates the camera about the centre of the focus plane: yaw about the world's vertical axis, then pitch about
+     * the camera's horizontal axis, both in radians. Pitch stops short of looking straight up or down.
+     */
+    void orbit(T yaw, T pitch) {
+        auto pivot = origin + focusDist * unitLookDir;
+        auto up = Vec3T<T>(0, 1, 0);
+        auto lookDir = rotate(unitLookDir, up, yaw);
+        auto pitched = rotate(lookDir, unitVector(cross(lookDir, up)), pitch);
+        if (std::abs(dot(pitched, up)) < T(0.99)) {
+            lookDir = pitched;
+        }
+        unitLookDir = unitVector(lookDir);
+        origin = pivot - focusDist * unitLookDir;
+        updateView();
+    }
+
+    /**
+     * Moves the camera sideways by fractions of the width and height of the focus plane.
+     */
+    void pan(T right, T up) {
+        origin += right * horizontal + up * vertical;
+        updateView();
+    }
+
+    /**
+     * Moves the camera towards the centre of the focus plane, scaling the distance by factor; the focus plane
+     * stays where it is.
+     */
+    void dolly(T factor) {
+        auto pivot = origin + focusDist * unitLookDir;
+        focusDist *= factor;
+        origin = pivot - focusDist * unitLookDir;
+        updateView();
     }
 
-    [[nodiscard]] double getLensRadius() const {
+    [[nodiscard]] T getAspectRatio() const {
+        return aspectRatio;
+    }
+
+    /**
+     * Widens or narrows the view to a new ratio of width to height; the vertical field of view stays.
+     */
+    void setAspectRatio(T value) {
+        aspectRatio = value;
+        updateView();
+    }
+
+    [[nodiscard]] T getLensRadius() const {
         return lensRadius;
     }
 
-    void setLensRadius(double radius) {
+    void setLensRadius(T radius) {
         lensRadius = radius;
     }
 
 private:
-    Point3 origin;
-    Point3 lowerLeftCorner;
-    Vec3 horizontal;
-    Vec3 vertical;
-    Vec3 unitHorizontal;
-    Vec3 unitVertical;
-    std::atomic<double> lensRadius;
+    Vec3T<T> origin;
+    Vec3T<T> unitLookDir;
+    T roll;
+    T vFov;
+    T aspectRatio;
+    T focusDist;
+    Vec3T<T> lowerLeftCorner;
+    Vec3T<T> horizontal;
+    Vec3T<T> vertical;
+    Vec3T<T> unitHorizontal;
+    Vec3T<T> unitVertical;
+    std::atomic<T> lensRadius;
+
+    void updateView() {
+        auto viewportHeight = 2 * focusDist * std::tan(vFov / 2);
+        auto viewportWidth = aspectRatio * viewportHeight;
+
+        auto vup = Vec3T<T>(-std::sin(roll), std::cos(roll), 0);
+        unitHorizontal = unitVector(cross(vup, -unitLookDir));
+        unitVertical = cross(-unitLookDir, unitHorizontal);
+
+        horizontal = viewportWidth * unitHorizontal;
+        vertical = viewportHeight * unitVertical;
+        lowerLeftCorner = origin - horizontal / 2 - vertical / 2 + unitLookDir * focusDist;
+    }
+
+    /**
+     * Rotates v by angle radians about the unit vector axis (Rodrigues' formula).
+     */
+    static Vec3T<T> rotate(const Vec3T<T> &v, const Vec3T<T> &axis, T angle) {
+        T c = std::cos(angle);
+        T s = std::sin(angle);
+        return v * c + cross(axis, v) * s + axis * dot(axis, v) * (1 - c);
+    }
 };
 
+using Camera = CameraT<Real>;
+
 #endif//RAYTRACER_CAMERA_H
@@ -0,0 +1,334 @@
+#ifndef RAYTRACER_CHECKPOINT_H
+#define RAYTRACER_CHECKPOINT_H
+
+#include "color.h"
+#include "mapped_file.h"
+#include "render_stats.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Accumulation state of a Renderer between two passes. Samples are drawn from counter-based generators keyed by
+ * seed, pixel and the pixel's sample count, so the per-pixel sample counts are also the position of every random
+ * stream: a resumed render continues exactly where the saved one stopped.
+ */
+struct RenderCheckpoint {
+    int width = 0;
+    int height = 0;
+    uint64_t seed = 0;
+    uint64_t sceneKey = 0;// identifies the scene and settings, chosen by the application
+    int samplesAccumulated = 0;
+    std::chrono::milliseconds renderTime{0};
+    unsigned long long generation = 0;
+    RenderStats stats;
+    std::vector<Color> cumulativeData;
+    std::vector<double> cumulativeLuminanceSquared;
+    std::vector<int> pixelSamples;
+    std::vector<uint8_t> isConverged;
+};
+
+/**
+ * Checkpoint encoding, used for checkpoint files and to send partial renders between processes: a header
+ * followed by the four per-pixel arrays. The header carries a hash of the arrays, so damaged data is rejected
+ * instead of resumed.
+ */
+namespace checkpoint_file {
+    constexpr char magic[8] = {'R', 'T', 'C', 'K', 'P', 'T', 0, 0};
+    constexpr uint32_t version = 3;// 2: statistics count paths ended by Russian roulette, 3: shadow rays and light hits
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t realSize;
+        int32_t width;
+        int32_t height;
+        uint64_t seed;
+        uint64_t sceneKey;
+        int64_t samplesAccumulated;
+        int64_t renderTimeMillis;
+        uint64_t generation;
+        uint64_t payloadHash;
+        RenderStats stats;
+    };
+
+    static_assert(std::is_trivially_copyable_v<Color>, "colors are stored as raw bytes");
+    static_assert(std::is_trivially_copyable_v<RenderStats>, "statistics are stored as raw bytes");
+
+    inline size_t payloadSize(size_t numPixels) {
+        return numPixels * (sizeof(Color) + sizeof(double) + sizeof(int) + sizeof(uint8_t));
+    }
+
+    /**
+     * 64-bit FNV-1a over 8-byte words, with the tail hashed bytewise.
+     */
+    inline uint64_t hashBytes(const char *data, size_t size) {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * 0x100000001b3ULL;
+        }
+        for (; i < size; i++) {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    inline size_t encodedSize(const RenderCheckpoint &checkpoint) {
+        return sizeof(Header) + payloadSize(checkpoint.pixelSamples.size());
+    }
+
+    /**
+     * Serializes the checkpoint into encodedSize(checkpoint) bytes at out.
+     */
+    void encode(const RenderCheckpoint &checkpoint, char *out) {
+        char *payload = out + sizeof(Header);
+        char *cursor = payload;
+        auto append = [&cursor](const auto &values) {
+            size_t bytes = values.size() * sizeof(values[0]);
+            std::memcpy(cursor, values.data(), bytes);
+            cursor += bytes;
+        };
+        append(checkpoint.cumulativeData);
+        append(checkpoint.cumulativeLuminanceSquared);
+        append(checkpoint.pixelSamples);
+        append(checkpoint.isConverged);
+
+        Header header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.realSize = sizeof(Real);
+        header.width = checkpoint.width;
+        header.height = checkpoint.height;
+        header.seed = checkpoint.seed;
+        header.sceneKey = checkpoint.sceneKey;
+        header.samplesAccumulated = checkpoint.samplesAccumulated;
+        header.renderTimeMillis = checkpoint.renderTime.count();
+        header.generation = checkpoint.generation;
+        header.payloadHash = hashBytes(payload, static_cast<size_t>(cursor - payload));
+        header.stats = checkpoint.stats;
+        std::memcpy(out, &header, sizeof(Header));
+    }
+
+    /**
+     * Deserializes a checkpoint produced by encode(). Throws std::runtime_error, naming source, if the data is
+     * damaged or was written by a build with another precision.
+     */
+    RenderCheckpoint decode(const char *data, size_t size, const std::string &source) {
+        Header header{};
+        if (size >= sizeof(Header)) {
+            std::memcpy(&header, data, sizeof(Header));
+        }
+        if (size < sizeof(Header) || std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version) {
+            throw std::runtime_error(source + " is not a checkpoint");
+        }
+        if (header.realSize != sizeof(Real)) {
+            throw std::runtime_error(source + " was written by a build with another floating point precision");
+        }
+        size_t numPixels = static_cast<size_t>(header.width) * header.height;
+        if (header.width <= 0 || header.height <= 0 || size != sizeof(Header) + payloadSize(numPixels)
+            || hashBytes(data + sizeof(Header), payloadSize(numPixels)) != header.payloadHash) {
+            throw std::runtime_error(source + " is damaged");
+        }
+
+        RenderCheckpoint checkpoint;
+        checkpoint.width = header.width;
+        checkpoint.height = header.height;
+        checkpoint.seed = header.seed;
+        checkpoint.sceneKey = header.sceneKey;
+        checkpoint.samplesAccumulated = static_cast<int>(header.samplesAccumulated);
+        checkpoint.renderTime = std::chrono::milliseconds(header.renderTimeMillis);
+        checkpoint.generation = header.generation;
+        checkpoint.stats = header.stats;
+
+        const char *in = data + sizeof(Header);
+        auto extract = [&in, numPixels](auto &values) {
+            values.resize(numPixels);
+            size_t bytes = numPixels * sizeof(values[0]);
+            std::memcpy(values.data(), in, bytes);
+            in += bytes;
+        };
+        extract(checkpoint.cumulativeData);
+        extract(checkpoint.cumulativeLuminanceSquared);
+        extract(checkpoint.pixelSamples);
+        extract(checkpoint.isConverged);
+        return checkpoint;
+    }
+
+    /**
+     * Writes the checkpoint into a memory-mapped temporary file, flushes it to disk and renames it over path,
+     * so a crash at any point leaves either the previous checkpoint or the new one. Throws std::runtime_error.
+     */
+    void write(const std::string &path, const RenderCheckpoint &checkpoint) {
+        std::string tempPath = path + ".tmp";
+        {
+            WritableMappedFile file(tempPath, encodedSize(checkpoint));
+            if (!file.isOpen()) {
+                throw std::runtime_error("Unable to map " + tempPath + " for writing");
+            }
+            encode(checkpoint, file.getData());
+            if (!file.flush()) {
+                std::remove(tempPath.c_str());
+                throw std::runtime_error("Failed to flush " + tempPath);
+            }
+        }
+        // Replacing in one step keeps the old checkpoint until the new one is complete.
+#ifdef _WIN32
+        bool isMoved = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        bool isMoved = std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+        if (!isMoved) {
+            std::remove(tempPath.c_str());
+            throw std::runtime_error("Failed to move the checkpoint to " + path);
+        }
+    }
+
+    /**
+     * Reads a checkpoint written by write().
+     *
+     * @return nothing if the file does not exist. Throws std::runtime_error if it exists but cannot be decoded.
+     */
+    std::optional<RenderCheckpoint> read(const std::string &path) {
+        MappedFile file(path);
+        if (!file.isOpen()) {
+            return {};
+        }
+        return decode(file.getData(), file.getSize(), path);
+    }
+}// namespace checkpoint_file
+
+/**
+ * Writes checkpoints on a background thread, so the render loop only pays for copying its buffers. If a write is
+ * still running when the next checkpoint arrives, the waiting one is replaced: only the newest state matters.
+ * The destructor finishes the pending write.
+ */
+class CheckpointWriter {
+public:
+    /**
+     *
+     * @param numPixels if not 0, a buffer of this size is allocated in the background for takeBuffer().
+     */
+    explicit CheckpointWriter(std::string path, size_t numPixels = 0)
+        : path(std::move(path)), numPixels(numPixels), thread([this] { run(); }) {}
+
+    CheckpointWriter(const CheckpointWriter &) = delete;
+
+    CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+    ~CheckpointWriter() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            isStopping = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    void submit(RenderCheckpoint checkpoint) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            pending = std::move(checkpoint);
+        }
+        cv.notify_all();
+    }
+
+    /**
+     * Returns the buffers of the last written checkpoint, or of the preallocated one, for reuse. Returns nothing
+     * while they are still being allocated or written.
+     */
+    std::optional<RenderCheckpoint> takeBuffer() {
+        std::lock_guard<std::mutex> lock(m);
+        auto buffer = std::move(spare);
+        spare.reset();
+        return buffer;
+    }
+
+    /**
+     * Blocks until every submitted checkpoint has been written or has failed.
+     */
+    void wait() {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [this] { return !pending && !isWriting; });
+    }
+
+    [[nodiscard]] int getNumWritten() const {
+        std::lock_guard<std::mutex> lock(m);
+        return numWritten;
+    }
+
+    [[nodiscard]] double getLastWriteMillis() const {
+        std::lock_guard<std::mutex> lock(m);
+        return lastWriteMillis;
+    }
+
+private:
+    std::string path;
+    size_t numPixels;
+    mutable std::mutex m;
+    std::condition_variable cv;
+    std::optional<RenderCheckpoint> pending;
+    std::optional<RenderCheckpoint> spare;
+    bool isStopping = false;
+    bool isWriting = false;
+    int numWritten = 0;
+    double lastWriteMillis = 0;
+    std::thread thread;
+
+    void run() {
+        if (numPixels > 0) {
+            RenderCheckpoint buffer;
+            buffer.cumulativeData.resize(numPixels);
+            buffer.cumulativeLuminanceSquared.resize(numPixels);
+            buffer.pixelSamples.resize(numPixels);
+            buffer.isConverged.resize(numPixels);
+            std::lock_guard<std::mutex> lock(m);
+            spare = std::move(buffer);
+        }
+
+        std::unique_lock<std::mutex> lock(m);
+        while (true) {
+            cv.wait(lock, [this] { return pending.has_value() || isStopping; });
+            if (!pending) {
+                return;
+            }
+            RenderCheckpoint checkpoint = std::move(*pending);
+            pending.reset();
+            isWriting = true;
+            lock.unlock();
+
+            auto start = std::chrono::steady_clock::now();
+            bool isWritten = true;
+            try {
+                checkpoint_file::write(path, checkpoint);
+            } catch (const std::exception &e) {
+                std::cerr << "Checkpoint not written: " << e.what() << "\n";
+                isWritten = false;
+            }
+            auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            lock.lock();
+            isWriting = false;
+            if (isWritten) {
+                numWritten++;
+                lastWriteMillis = elapsed;
+            }
+            spare = std::move(checkpoint);
+            cv.notify_all();
+        }
+    }
+};
+
+#endif//RAYTRACER_CHECKPOINT_H
@@ -0,0 +1,192 @@
+#ifndef RAYTRACER_CLOSED_SCENE_H
+#define RAYTRACER_CLOSED_SCENE_H
+
+#include "bvh.h"
+#include "dielectric.h"
+#include "diffuse_light.h"
+#include "hit_record.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "lambertian.h"
+#include "metal.h"
+#include "sphere.h"
+#include "triangle_mesh.h"
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+/**
+ * Calls f with the material as its built-in class, picked by a switch on its type tag, so that the calls f makes
+ * are resolved statically and can be inlined. Materials of other types are passed as Material.
+ */
+template<typename F>
+decltype(auto) visitMaterial(const Material &material, F &&f) {
+    switch (material.getType()) {
+        case MaterialType::Lambertian:
+            return f(static_cast<const Lambertian &>(material));
+        case MaterialType::Metal:
+            return f(static_cast<const Metal &>(material));
+        case MaterialType::Dielectric:
+            return f(static_cast<const Dielectric &>(material));
+        case MaterialType::DiffuseLight:
+            return f(static_cast<const DiffuseLight &>(material));
+        default:
+            return f(material);
+    }
+}
+
+/**
+ * The built-in materials, stored by value.
+ */
+using ClosedMaterial = std::variant<Lambertian, Metal, Dielectric, DiffuseLight>;
+
+/**
+ * A scene whose primitive and material types are all known at compile time: spheres and triangle meshes with
+ * built-in materials. Primitives are variants in one flat array under a BVH, intersected through std::visit, and
+ * sphere materials are variants in another, so a ray costs no virtual call until it reaches a mesh. The renderer
+ * recognizes the scene and dispatches on its materials by type tag, see visitMaterial().
+ *
+ * The open Hittable and Material hierarchies stay the way to add new kinds of objects; scenes holding any, or
+ * instances, are rejected.
+ */
+class ClosedScene final : public Hittable {
+public:
+    struct SpherePrimitive {
+        Point3 center;
+        Real radius;
+        int material;// index into the materials
+    };
+
+    /**
+     * A mesh keeps its own hierarchy and material, which is intersected through its concrete class.
+     */
+    struct MeshPrimitive {
+        const TriangleMesh *mesh;
+    };
+
+    using Primitive = std::variant<SpherePrimitive, MeshPrimitive>;
+
+    /**
+     * Copies the spheres and materials of a list and shares its meshes. Throws std::invalid_argument if the list
+     * holds other objects or materials.
+     */
+    explicit ClosedScene(const HittableList &list, int maxLeafSize = 4) {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        std::vector<Primitive> unordered;
+        std::vector<Aabb> bounds;
+        for (const auto &object: list.objects) {
+            if (auto sphere = std::dynamic_pointer_cast<Sphere>(object)) {
+                unordered.emplace_back(SpherePrimitive{sphere->getCenter(), sphere->getRadius(), materialId(*sphere->getMaterial())});
+            } else if (auto mesh = std::dynamic_pointer_cast<TriangleMesh>(object)) {
+                toClosedMaterial(*mesh->getMaterial());// only checks that the material is built in
+                meshes.push_back(mesh);
+                unordered.emplace_back(MeshPrimitive{mesh.get()});
+            } else {
+                throw std::invalid_argument("ClosedScene can only hold spheres and triangle meshes");
+            }
+            bounds.push_back(object->boundingBox());
+        }
+
+        auto result = BvhBuilder(maxLeafSize).build(bounds);
+        nodes = std::move(result.nodes);
+        primitives.reserve(result.primitiveIndices.size());
+        for (int index: result.primitiveIndices) {
+            primitives.push_back(unordered[index]);
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        buildTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    }
+
+    [[nodiscard]] std::optional<Intersection> intersect(const Ray &r, Real tMin, Real tMax) const override {
+        return traverseBvh(nodes, r, tMin, tMax, [&](int i, Real nearestHitDist) {
+            return std::visit([&](const auto &primitive) { return intersectPrimitive(primitive, i, r, tMin, nearestHitDist); },
+                              primitives[i]);
+        });
+    }
+
+    [[nodiscard]] HitRecord resolve(const Ray &r, const Intersection &intersection) const override {
+        if (intersection.object != this) {
+            return static_cast<const TriangleMesh *>(intersection.object)->TriangleMesh::resolve(r, intersection);
+        }
+        const auto &sphere = std::get<SpherePrimitive>(primitives[intersection.index]);
+        const auto *material = std::visit([](const auto &m) -> const Material * { return &m; }, materials[sphere.material]);
+        return Sphere::resolveSphere(sphere.center, sphere.radius, r, intersection.t, material);
+    }
+
+    /**
+     * Like Hittable::hit(), without virtual calls: the class is final, so its own intersect() and resolve() are
+     * called directly.
+     */
+    [[nodiscard]] std::optional<HitRecord> hit(const Ray &r, Real tMin, Real tMax) const {
+        auto intersection = intersect(r, tMin, tMax);
+        if (!intersection) {
+            return {};
+        }
+        return resolve(r, *intersection);
+    }
+
+    [[nodiscard]] Aabb boundingBox() const override {
+        return nodes.empty() ? Aabb() : nodes[0].bounds;
+    }
+
+    [[nodiscard]] int getPrimitiveCount() const {
+        return static_cast<int>(primitives.size());
+    }
+
+    [[nodiscard]] int getMaterialCount() const {
+        return static_cast<int>(materials.size());
+    }
+
+    [[nodiscard]] std::chrono::microseconds getBuildTime() const {
+        return buildTime;
+    }
+
+private:
+    std::vector<BvhNode> nodes;
+    std::vector<Primitive> primitives;// in the order the leaves reference them
+    std::vector<ClosedMaterial> materials;
+    std::unordered_map<const Material *, int> materialIds;// of the materials copied so far
+    std::vector<std::shared_ptr<TriangleMesh>> meshes;
+    std::chrono::microseconds buildTime{0};
+
+    std::optional<Intersection> intersectPrimitive(const SpherePrimitive &sphere, int i, const Ray &r, Real tMin, Real tMax) const {
+        if (auto t = Sphere::intersectSphere(sphere.center, sphere.radius, r, tMin, tMax)) {
+            return Intersection{*t, this, i};
+        }
+        return {};
+    }
+
+    static std::optional<Intersection> intersectPrimitive(const MeshPrimitive &mesh, int, const Ray &r, Real tMin, Real tMax) {
+        return mesh.mesh->TriangleMesh::intersect(r, tMin, tMax);
+    }
+
+    /**
+     * Index of the copy of material, which is made the first time the material is seen; spheres sharing a
+     * material share the copy.
+     */
+    int materialId(const Material &material) {
+        auto [it, isNew] = materialIds.try_emplace(&material, static_cast<int>(materials.size()));
+        if (isNew) {
+            materials.push_back(toClosedMaterial(material));
+        }
+        return it->second;
+    }
+
+    static ClosedMaterial toClosedMaterial(const Material &material) {
+        return visitMaterial(material, [](const auto &m) -> ClosedMaterial {
+            if constexpr (std::is_same_v<std::decay_t<decltype(m)>, Material>) {
+                throw std::invalid_argument("ClosedScene can only hold built-in materials");
+            } else {
+                return m;
+            }
+        });
+    }
+};
+
+#endif//RAYTRACER_CLOSED_SCENE_H
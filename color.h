@@ -12,13 +12,23 @@ void writeColor(std::ostream &out, Color color) {
     auto b = color.z();
 
     // gamma correction
-    r = sqrt(r);
-    g = sqrt(g);
-    b = sqrt(b);
+    r = std::sqrt(r);
+    g = std::sqrt(g);
+    b = std::sqrt(b);
 
-    out << static_cast<int>(256 * std::clamp(r, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * std::clamp(g, 0.0, 0.999)) << ' '
-        << static_cast<int>(256 * std::clamp(b, 0.0, 0.999)) << '\n';
+    out << static_cast<int>(256 * std::clamp<Real>(r, 0, 0.999)) << ' '
+        << static_cast<int>(256 * std::clamp<Real>(g, 0, 0.999)) << ' '
+        << static_cast<int>(256 * std::clamp<Real>(b, 0, 0.999)) << '\n';
+}
+
+/**
+ *
+ * @return the sky gradient seen by a ray that escapes the scene.
+ */
+inline Color skyColor(const Vec3 &direction) {
+    Vec3 unitDirection = unitVector(direction);
+    Real t = 0.5 * (unitDirection.y() + 1.0);
+    return (1.0 - t) * Color(1.0, 1.0, 1.0) + t * Color(0.5, 0.7, 1.0);
 }
 
 int toInt(const Color& color) {
@@ -27,13 +37,13 @@ int toInt(const Color& color) {
     auto b = color.z();
 
     // gamma correction
-    r = sqrt(r);
-    g = sqrt(g);
-    b = sqrt(b);
+    r = std::sqrt(r);
+    g = std::sqrt(g);
+    b = std::sqrt(b);
 
-    auto rr = static_cast<int> (256 * std::clamp(r, 0.0, 0.999));
-    auto gg = static_cast<int>(256 * std::clamp(g, 0.0, 0.999));
-    auto bb = static_cast<int>(256 * std::clamp(b, 0.0, 0.999));
+    auto rr = static_cast<int> (256 * std::clamp<Real>(r, 0, 0.999));
+    auto gg = static_cast<int>(256 * std::clamp<Real>(g, 0, 0.999));
+    auto bb = static_cast<int>(256 * std::clamp<Real>(b, 0, 0.999));
     auto a = 255;
     return (a << 24) + (bb << 16) + (gg << 8) + rr;
 }
@@ -0,0 +1,241 @@
+#ifndef RAYTRACER_DENOISER_H
+#define RAYTRACER_DENOISER_H
+
+#include "color.h"
+#include "hit_record.h"
+#include "tile_scheduler.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * Edge-avoiding à-trous wavelet filter (Dammertz et al., 2010) for the accumulated image of a path tracer.
+ *
+ * Each iteration convolves the image with the 5x5 B3-spline kernel, its taps spread 2^i pixels apart, so three
+ * iterations cover 29 pixels across at 75 taps per pixel. A tap is weighted down where its colour differs from
+ * the centre by more than the centre's noise, or where the first-hit normal, depth or albedo differ, so noise within
+ * a surface is smoothed while edges survive. The colour tolerance follows the per-pixel noise estimate, so the
+ * filter backs off as samples accumulate.
+ *
+ * Inputs are kept in planar float arrays and each tap is applied to a whole span of a row at once, so the inner
+ * loop is contiguous and branch-free for the compiler to vectorize. Tiles are spread over the renderer's workers.
+ */
+class Denoiser {
+public:
+    int iterations = 3;
+    float colorSigma = 4;    // colour tolerance in standard errors of the centre pixel
+    float normalSigma = 0.5f;// tolerated distance between (averaged) unit normals
+    float depthSigma = 0.05f;// tolerated relative depth difference per pixel of tap distance
+    float albedoSigma = 0.5f;
+
+    /**
+     * Sizes the planes for an image; their contents are undefined until every pixel has been set.
+     */
+    void resize(int imageWidth, int imageHeight) {
+        width = imageWidth;
+        height = imageHeight;
+        size_t numPixels = static_cast<size_t>(width) * height;
+        for (auto *plane: {&color[0], &color[1], &color[2], &filtered[0], &filtered[1], &filtered[2], &normal[0],
+                           &normal[1], &normal[2], &albedo[0], &albedo[1], &albedo[2], &depth, &variance, &colorScale, &depthScale}) {
+            plane->resize(numPixels);
+        }
+    }
+
+    /**
+     * Sets the inputs of pixel i.
+     *
+     * @param mean the pixel's mean radiance.
+     * @param variance variance of the mean's luminance, i.e. the squared standard error.
+     * @param features the pixel's mean first-hit features; all zero if unknown.
+     */
+    void setPixel(int i, const Color &mean, double meanVariance, const SampleFeatures &features) {
+        for (int c = 0; c < 3; c++) {
+            color[c][i] = static_cast<float>(mean[c]);
+            normal[c][i] = static_cast<float>(features.normal[c]);
+            albedo[c][i] = static_cast<float>(features.albedo[c]);
+        }
+        auto d = static_cast<float>(features.depth);
+        depth[i] = d;
+        variance[i] = static_cast<float>(meanVariance);
+        depthScale[i] = 1 / (depthSigma * depthSigma * d * d + 1e-8f);
+    }
+
+    [[nodiscard]] Color getPixel(int i) const {
+        return {color[0][i], color[1][i], color[2][i]};
+    }
+
+    /**
+     * Filters the colour planes in place.
+     */
+    void filter(TileScheduler &scheduler) {
+        rowBuffers.resize(scheduler.getNumThreads());
+        scheduler.run(
+                width,
+                height,
+                [this](const Tile &tile, int) {
+                    setColorScale(tile);
+                },
+                neverCancelled);
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            scheduler.run(
+                    width,
+                    height,
+                    [this, iteration](const Tile &tile, int worker) {
+                        filterTile(tile, iteration, rowBuffers[worker]);
+                    },
+                    neverCancelled);
+            std::swap(color, filtered);
+        }
+    }
+
+private:
+    static constexpr float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+    static constexpr int32_t minExponentBits = static_cast<int32_t>(0xc2c80000u);// -100.0f
+
+    int width = 0;
+    int height = 0;
+    std::array<std::vector<float>, 3> color;
+    std::array<std::vector<float>, 3> filtered;
+    std::array<std::vector<float>, 3> normal;
+    std::array<std::vector<float>, 3> albedo;
+    std::vector<float> depth;     // 0 where the pixel saw the sky
+    std::vector<float> variance;
+    std::vector<float> colorScale;// inverse squared colour tolerance of the first iteration
+    std::vector<float> depthScale;// inverse squared depth tolerance at a tap distance of one pixel
+    std::vector<std::vector<float>> rowBuffers;// per worker: weighted sums of one tile row
+    const std::atomic_bool neverCancelled = false;
+
+    /**
+     * e^x for x <= 0, to about 1e-4 relative error. Unlike std::exp it has no error handling and no branches, so
+     * loops calling it vectorize.
+     */
+    static float expNegative(float x) {
+        float t = x * 1.44269504f;// in powers of two
+        // Clamped far from the denormals, which are slow. The clamp works on the bit pattern: for negative floats a
+        // larger magnitude is a larger integer, and integer compares vectorize where float compares, which may trap,
+        // do not.
+        int32_t tBits;
+        std::memcpy(&tBits, &t, sizeof(t));
+        tBits = std::min(tBits, minExponentBits);
+        std::memcpy(&t, &tBits, sizeof(t));
+        auto i = static_cast<int32_t>(t);// rounds towards zero, so f lies in (-1, 0]
+        float f = t - static_cast<float>(i);
+        float p = 1 + f * (0.693147f + f * (0.240227f + f * (0.0555041f + f * (0.00961813f + f * 0.00133336f))));
+        int32_t bits = (i + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+        return p * scale;
+    }
+
+    /**
+     * Derives the colour tolerance from the variance averaged over 3x3 pixels, since the estimate of a single
+     * pixel from a few samples is itself noisy.
+     */
+    void setColorScale(const Tile &tile) {
+        for (int y = tile.y0; y < tile.y1; y++) {
+            for (int x = tile.x0; x < tile.x1; x++) {
+                float sum = 0;
+                int count = 0;
+                for (int qy = std::max(y - 1, 0); qy <= std::min(y + 1, height - 1); qy++) {
+                    for (int qx = std::max(x - 1, 0); qx <= std::min(x + 1, width - 1); qx++) {
+                        sum += variance[qy * width + qx];
+                        count++;
+                    }
+                }
+                // A colour difference of one standard error per channel costs exp(-1 / colorSigma^2) at the first
+                // iteration.
+                colorScale[y * width + x] = 1 / (3 * colorSigma * colorSigma * sum / count + 1e-6f);
+            }
+        }
+    }
+
+    void filterTile(const Tile &tile, int iteration, std::vector<float> &buffer) {
+        const int step = 1 << iteration;
+        const int n = tile.width();
+        // Each iteration removes most of the noise left, so the colour tolerance shrinks by four every iteration.
+        const float colorFactor = std::ldexp(1.0f, 4 * iteration);
+        buffer.resize(4 * static_cast<size_t>(n));
+        float *sumR = buffer.data();
+        float *sumG = sumR + n;
+        float *sumB = sumG + n;
+        float *sumW = sumB + n;
+
+        for (int y = tile.y0; y < tile.y1; y++) {
+            std::fill(buffer.begin(), buffer.end(), 0.0f);
+            const int row = y * width;
+            for (int ty = -2; ty <= 2; ty++) {
+                const int qy = y + ty * step;
+                if (qy < 0 || qy >= height) {
+                    continue;
+                }
+                for (int tx = -2; tx <= 2; tx++) {
+                    const int dx = tx * step;
+                    const float distance = static_cast<float>(std::max({std::abs(tx), std::abs(ty), 1}) * step);
+                    // Only the part of the row whose tap falls inside the image.
+                    const int begin = std::max(tile.x0, -dx);
+                    const int end = std::min(tile.x1, width - dx);
+                    addTap(row + begin, (qy - y) * width + dx, end - begin, kernel[ty + 2] * kernel[tx + 2], colorFactor,
+                           1 / (distance * distance), sumR + begin - tile.x0, sumG + begin - tile.x0,
+                           sumB + begin - tile.x0, sumW + begin - tile.x0);
+                }
+            }
+            // The centre tap always has weight, so sumW > 0.
+            for (int k = 0; k < n; k++) {
+                filtered[0][row + tile.x0 + k] = sumR[k] / sumW[k];
+                filtered[1][row + tile.x0 + k] = sumG[k] / sumW[k];
+                filtered[2][row + tile.x0 + k] = sumB[k] / sumW[k];
+            }
+        }
+    }
+
+    /**
+     * Adds the tap offset pixels away to the weighted sums of the count pixels from p on. The sums are restrict
+     * parameters (understood by GCC, Clang and MSVC), so the compiler knows they do not overlap the planes and
+     * vectorizes the loop.
+     */
+    void addTap(int p, int offset, int count, float h, float colorFactor, float depthFactor, float *__restrict sumR,
+                float *__restrict sumG, float *__restrict sumB, float *__restrict sumW) const {
+        const float normalScale = 1 / (normalSigma * normalSigma);
+        const float albedoScale = 1 / (albedoSigma * albedoSigma);
+        const float *r = color[0].data() + p;
+        const float *g = color[1].data() + p;
+        const float *b = color[2].data() + p;
+        const float *nx = normal[0].data() + p;
+        const float *ny = normal[1].data() + p;
+        const float *nz = normal[2].data() + p;
+        const float *ar = albedo[0].data() + p;
+        const float *ag = albedo[1].data() + p;
+        const float *ab = albedo[2].data() + p;
+        const float *d = depth.data() + p;
+        const float *cs = colorScale.data() + p;
+        const float *ds = depthScale.data() + p;
+        for (int k = 0; k < count; k++) {
+            const int q = k + offset;
+            float dr = r[q] - r[k];
+            float dg = g[q] - g[k];
+            float db = b[q] - b[k];
+            float dnx = nx[q] - nx[k];
+            float dny = ny[q] - ny[k];
+            float dnz = nz[q] - nz[k];
+            float dar = ar[q] - ar[k];
+            float dag = ag[q] - ag[k];
+            float dab = ab[q] - ab[k];
+            float dd = d[q] - d[k];
+            float e = (dr * dr + dg * dg + db * db) * cs[k] * colorFactor
+                      + (dnx * dnx + dny * dny + dnz * dnz) * normalScale
+                      + (dar * dar + dag * dag + dab * dab) * albedoScale
+                      + dd * dd * ds[k] * depthFactor;
+            float w = h * expNegative(-e);
+            sumR[k] += w * r[q];
+            sumG[k] += w * g[q];
+            sumB[k] += w * b[q];
+            sumW[k] += w;
+        }
+    }
+};
+
+#endif//RAYTRACER_DENOISER_H
@@ -4,14 +4,14 @@
 #include "hit_record.h"
 #include "material.h"
 
-class Dielectric : public Material {
+class Dielectric final : public Material {
 public:
-    explicit Dielectric(double ir) : Material(Color(1.0, 1.0, 1.0)), ir(ir) {}
+    explicit Dielectric(Real ir) : Material(MaterialType::Dielectric, Color(1.0, 1.0, 1.0)), ir(ir) {}
 
-    [[nodiscard]] std::optional<Ray> scatter(const Ray &r, const HitRecord &rec) const override {
-        double refraction_ratio = rec.isFrontFace ? (1.0 / ir) : ir;
+    [[nodiscard]] std::optional<Ray> scatter(const Ray &r, const HitRecord &rec, Rng &rng) const override {
+        Real refraction_ratio = rec.isFrontFace ? (1 / ir) : ir;
 
-        if (auto refracted = refract(r.direction(), rec.normal, refraction_ratio)) {
+        if (auto refracted = refract(r.direction(), rec.normal, refraction_ratio, rng)) {
             return Ray(rec.p, *refracted);
         }
 
@@ -19,29 +19,44 @@ public:
         return Ray(rec.p, reflected);
     }
 
+    /**
+     * Refraction and reflection each have a single direction, so no other direction has a density.
+     */
+    [[nodiscard]] Real pdf(const Ray &r, const HitRecord &rec, const Vec3 &direction) const override {
+        return 0;
+    }
+
+    [[nodiscard]] bool isSpecular() const override {
+        return true;
+    }
+
+    [[nodiscard]] Real getIndexOfRefraction() const {
+        return ir;
+    }
+
 private:
-    double ir;// Index of Refraction
+    Real ir;// Index of Refraction
 
-    static std::optional<Vec3> refract(const Vec3 &v, const Vec3 &n, double refractionRatio) {
+    static std::optional<Vec3> refract(const Vec3 &v, const Vec3 &n, Real refractionRatio, Rng &rng) {
         Vec3 uv = unitVector(v);
-        auto cosTheta = std::min(dot(-uv, n), 1.0);
-        double sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+        auto cosTheta = std::min<Real>(dot(-uv, n), 1);
+        Real sinTheta = std::sqrt(1 - cosTheta * cosTheta);
 
         bool cannotRefract = refractionRatio * sinTheta > 1.0;
-        if (cannotRefract || reflectance(cosTheta, refractionRatio) > randomDouble()) {
+        if (cannotRefract || reflectance(cosTheta, refractionRatio) > randomDouble(rng)) {
             return {};
         }
 
         Vec3 rOutPerp = refractionRatio * (uv + cosTheta * n);
-        Vec3 rOutParallel = -sqrt(std::abs(1.0 - rOutPerp.lengthSquared())) * n;
+        Vec3 rOutParallel = -std::sqrt(std::abs(1 - rOutPerp.lengthSquared())) * n;
         return rOutPerp + rOutParallel;
     }
 
-    static double reflectance(double cosine, double refractionRatio) {
+    static Real reflectance(Real cosine, Real refractionRatio) {
         // Use Schlick's approximation for reflectance.
         auto r0 = (1 - refractionRatio) / (1 + refractionRatio);
         r0 = r0 * r0;
-        return r0 + (1 - r0) * pow((1 - cosine), 5);
+        return r0 + (1 - r0) * std::pow(1 - cosine, 5);
     }
 };
 
@@ -0,0 +1,19 @@
+#ifndef RAYTRACER_DIFFUSE_LIGHT_H
+#define RAYTRACER_DIFFUSE_LIGHT_H
+
+#include "hit_record.h"
+#include "material.h"
+
+/**
+ * Emits the same radiance in every direction from its front face and reflects nothing.
+ */
+class DiffuseLight final : public Material {
+public:
+    explicit DiffuseLight(const Color &emission) : Material(MaterialType::DiffuseLight, Color(0, 0, 0), emission) {}
+
+    [[nodiscard]] std::optional<Ray> scatter(const Ray &r, const HitRecord &rec, Rng &rng) const override {
+        return {};
+    }
+};
+
+#endif//RAYTRACER_DIFFUSE_LIGHT_H
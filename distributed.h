@@ -0,0 +1,234 @@
+#ifndef RAYTRACER_DISTRIBUTED_H
+#define RAYTRACER_DISTRIBUTED_H
+
+#include "checkpoint.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Child process whose standard output is a pipe to this process. Only available on POSIX systems; the constructor
+ * throws std::runtime_error elsewhere or if the process cannot be started.
+ */
+class WorkerProcess {
+public:
+    explicit WorkerProcess(const std::vector<std::string> &args) {
+#ifdef _WIN32
+        throw std::runtime_error("Worker processes are only supported on POSIX systems");
+#else
+        int fds[2];
+        if (pipe(fds) != 0) {
+            throw std::runtime_error("Unable to create a pipe for a worker");
+        }
+        pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            throw std::runtime_error("Unable to start a worker");
+        }
+        if (pid == 0) {
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            std::vector<char *> argv;
+            for (const auto &arg: args) {
+                argv.push_back(const_cast<char *>(arg.c_str()));
+            }
+            argv.push_back(nullptr);
+            execvp(argv[0], argv.data());
+            _exit(127);
+        }
+        close(fds[1]);
+        fd = fds[0];
+#endif
+    }
+
+    WorkerProcess(const WorkerProcess &) = delete;
+
+    WorkerProcess &operator=(const WorkerProcess &) = delete;
+
+    ~WorkerProcess() {
+        wait();
+    }
+
+    /**
+     * Reads the worker's output until it closes the pipe.
+     */
+    std::vector<char> readOutput() {
+        std::vector<char> output;
+#ifndef _WIN32
+        char buffer[1 << 16];
+        while (fd >= 0) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            output.insert(output.end(), buffer, buffer + n);
+        }
+#endif
+        return output;
+    }
+
+    /**
+     * Waits for the worker to exit.
+     *
+     * @return its exit code, or -1 if it did not exit normally.
+     */
+    int wait() {
+#ifndef _WIN32
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+        if (pid > 0) {
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+            }
+            pid = -1;
+            exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        }
+#endif
+        return exitCode;
+    }
+
+private:
+    int fd = -1;
+    int exitCode = -1;
+#ifndef _WIN32
+    pid_t pid = -1;
+#endif
+};
+
+/**
+ * Outcome of a render split across worker processes.
+ */
+struct DistributedRender {
+    RenderCheckpoint accumulation;// sum of the workers' accumulations
+    double wallSeconds = 0;
+    std::vector<double> workerRenderSeconds;
+
+    /**
+     * Pixel samples rendered per second of wall time, the throughput to compare across worker counts.
+     */
+    [[nodiscard]] double pixelSamplesPerSecond() const {
+        long long samples = 0;
+        for (int n: accumulation.pixelSamples) {
+            samples += n;
+        }
+        return wallSeconds > 0 ? samples / wallSeconds : 0;
+    }
+
+    /**
+     * Fraction of the workers' wall time spent rendering passes; the rest went to starting processes, loading
+     * the scene, transferring and merging buffers, or waiting for the slowest worker. This is overhead only: workers
+     * sharing cores render slower without lowering it.
+     */
+    [[nodiscard]] double renderFraction() const {
+        double renderSeconds = 0;
+        for (double seconds: workerRenderSeconds) {
+            renderSeconds += seconds;
+        }
+        return wallSeconds > 0 ? renderSeconds / (wallSeconds * workerRenderSeconds.size()) : 0;
+    }
+};
+
+/**
+ * Splits samples into at most numWorkers contiguous ranges (first sample, count) whose sizes differ by at most one.
+ * Empty ranges are left out, so there are fewer ranges than workers if there are fewer samples.
+ */
+std::vector<std::pair<int, int>> splitSampleRange(int samples, int numWorkers) {
+    std::vector<std::pair<int, int>> ranges;
+    int first = 0;
+    for (int i = 0; i < numWorkers; i++) {
+        int count = samples / numWorkers + (i < samples % numWorkers ? 1 : 0);
+        if (count == 0) {
+            break;// later ranges are no larger
+        }
+        ranges.emplace_back(first, count);
+        first += count;
+    }
+    return ranges;
+}
+
+/**
+ * Adds the samples of part to total. Throws std::invalid_argument if the two differ in resolution or seed.
+ */
+void mergeAccumulation(RenderCheckpoint &total, const RenderCheckpoint &part) {
+    if (part.width != total.width || part.height != total.height || part.seed != total.seed) {
+        throw std::invalid_argument("Partial renders differ in resolution or seed");
+    }
+    for (size_t i = 0; i < total.pixelSamples.size(); i++) {
+        total.cumulativeData[i] += part.cumulativeData[i];
+        total.cumulativeLuminanceSquared[i] += part.cumulativeLuminanceSquared[i];
+        total.pixelSamples[i] += part.pixelSamples[i];
+        total.isConverged[i] = 0;// convergence is only tracked within one renderer
+    }
+    total.samplesAccumulated += part.samplesAccumulated;
+    total.renderTime += part.renderTime;
+    total.stats.merge(part.stats);
+}
+
+/**
+ * Renders samplesPerPixel samples with numWorkers processes. Worker i runs workerCommand followed by
+ * "--worker-samples <first>:<count>" for its range and writes its accumulation, encoded by
+ * checkpoint_file::encode(), to standard output. Throws std::runtime_error if a worker fails.
+ */
+DistributedRender renderDistributed(const std::vector<std::string> &workerCommand, int samplesPerPixel, int numWorkers) {
+    auto start = std::chrono::steady_clock::now();
+    auto ranges = splitSampleRange(samplesPerPixel, numWorkers);
+
+    std::vector<std::unique_ptr<WorkerProcess>> workers;
+    for (const auto &[first, count]: ranges) {
+        auto args = workerCommand;
+        args.emplace_back("--worker-samples");
+        args.push_back(std::to_string(first) + ":" + std::to_string(count));
+        workers.push_back(std::make_unique<WorkerProcess>(args));
+    }
+
+    // Pipes hold far less than an accumulation buffer, so every worker needs its own reader.
+    std::vector<std::vector<char>> outputs(workers.size());
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < workers.size(); i++) {
+        readers.emplace_back([&outputs, &workers, i] { outputs[i] = workers[i]->readOutput(); });
+    }
+    for (auto &reader: readers) {
+        reader.join();
+    }
+
+    DistributedRender result;
+    for (size_t i = 0; i < workers.size(); i++) {
+        std::string name = "worker " + std::to_string(i);
+        int exitCode = workers[i]->wait();
+        if (exitCode != 0) {
+            throw std::runtime_error(name + " failed with exit code " + std::to_string(exitCode));
+        }
+        auto part = checkpoint_file::decode(outputs[i].data(), outputs[i].size(), "output of " + name);
+        outputs[i] = {};
+        result.workerRenderSeconds.push_back(part.renderTime.count() / 1000.0);
+        if (i == 0) {
+            result.accumulation = std::move(part);
+            auto &isConverged = result.accumulation.isConverged;
+            std::fill(isConverged.begin(), isConverged.end(), 0);
+        } else {
+            mergeAccumulation(result.accumulation, part);
+        }
+    }
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+#endif//RAYTRACER_DISTRIBUTED_H
@@ -0,0 +1,83 @@
+#ifndef RAYTRACER_DYNAMIC_RESOLUTION_H
+#define RAYTRACER_DYNAMIC_RESOLUTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+/**
+ * Picks the render scale, the fraction of the window's width and height that is rendered, so that a progressive
+ * pass takes about the frame-time budget. The time of a pass grows with its number of pixels, so the scale that fits
+ * is the current one times the square root of budget over pass time.
+ *
+ * Every change resamples the accumulation, which blurs it until new samples take over, so pass times within a
+ * tolerance of the budget are left alone, and scales are rounded to steps so that noise in the timing cannot make
+ * the resolution flicker.
+ */
+class DynamicResolution {
+public:
+    static constexpr double minScale = 0.25;
+    static constexpr double maxScale = 1;
+    static constexpr double scaleStep = 1.0 / 16;
+    static constexpr int minSize = 2;// the renderer maps pixels to the screen by dividing by the size minus one
+
+    double tolerance = 0.25;// relative deviation of a pass time from the budget that is tolerated
+
+    explicit DynamicResolution(double budgetMillis = 50) : budgetMillis(budgetMillis) {}
+
+    void setBudget(double millis) {
+        budgetMillis = millis;
+    }
+
+    [[nodiscard]] double getBudget() const {
+        return budgetMillis;
+    }
+
+    [[nodiscard]] double getScale() const {
+        return scale;
+    }
+
+    void setScale(double value) {
+        scale = std::clamp(value, minScale, maxScale);
+    }
+
+    /**
+     * Takes the time of a pass rendered at the current scale and adapts the scale to it, by at most a factor of
+     * two at a time.
+     *
+     * @return whether the scale changed.
+     */
+    bool update(double passMillis) {
+        if (passMillis <= 0) {
+            return false;
+        }
+        double ratio = passMillis / budgetMillis;
+        if (std::abs(ratio - 1) <= tolerance) {
+            return false;
+        }
+        double target = std::clamp(scale / std::sqrt(ratio), scale / 2, scale * 2);
+        // Rounded towards the current scale, so that a step is only taken when the budget calls for all of it.
+        double steps = target / scaleStep;
+        target = (target < scale ? std::ceil(steps) : std::floor(steps)) * scaleStep;
+        target = std::clamp(target, minScale, maxScale);
+        if (target == scale) {
+            return false;
+        }
+        scale = target;
+        return true;
+    }
+
+    /**
+     * Render resolution for a window at the current scale, at least minSize pixels each way.
+     */
+    [[nodiscard]] std::pair<int, int> renderSize(int windowWidth, int windowHeight) const {
+        return {std::max(minSize, static_cast<int>(std::lround(windowWidth * scale))),
+                std::max(minSize, static_cast<int>(std::lround(windowHeight * scale)))};
+    }
+
+private:
+    double budgetMillis;
+    double scale = maxScale;
+};
+
+#endif//RAYTRACER_DYNAMIC_RESOLUTION_H
@@ -10,12 +10,41 @@
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <memory>
 #include <mutex>
-#include <thread>
+#include <utility>
 
 class Gui {
 public:
+    /**
+     * Cost of the last texture upload.
+     */
+    struct UploadStats {
+        long long bytes = 0;
+        int regions = 0;
+        std::chrono::microseconds time{0};
+
+        [[nodiscard]] double megabytesPerSecond() const {
+            return time.count() > 0 ? static_cast<double>(bytes) / time.count() : 0;
+        }
+    };
+
+    /**
+     * How the render manager handled the settings changes so far.
+     */
+    struct InteractionStats {
+        long long commands = 0;       // settings changes received from the GUI
+        long long batches = 0;        // updates applied, after coalescing queued changes
+        long long completedPasses = 0;
+        long long discardedPasses = 0;// cancelled because a change made them stale
+        double discardedMillis = 0;   // render time spent on discarded passes
+        double inputLatencyMillis = 0;// from the last change to the first frame showing it
+    };
+
     Gui();
 
     void run();
@@ -38,6 +67,11 @@ public:
         return image;
     }
 
+    void setInteractionStats(const InteractionStats &value) {
+        std::lock_guard<std::mutex> lock(m);
+        interactionStats = value;
+    }
+
     [[nodiscard]] bool isClosing() const {
         return glfwWindowShouldClose(window);
     }
@@ -51,11 +85,31 @@ private:
     GLFWwindow *window{};
     std::shared_ptr<Image> image;
     GLuint texture{};
+    GLuint pixelBuffer{};
+    int textureWidth = 0;
+    int textureHeight = 0;
+    unsigned long long uploadedGeneration = 0;// 0: texture content unknown
+    bool isSampleMapUploaded = false;
+    UploadStats uploadStats;
+    InteractionStats interactionStats;
     std::mutex m;
 
+    static constexpr double orbitRadiansPerPixel = 0.005;
+    static constexpr double dollyFactorPerStep = 0.9;// per step of the mouse wheel, towards the scene
+
     std::atomic_int numSamples;
     std::atomic_int maxDepth;
     std::atomic<float> lensRadius;
+    std::atomic_bool adaptiveSampling;
+    std::atomic<float> targetNoise;
+    std::atomic<Integrator> integrator;
+    std::atomic_bool denoising;
+    std::atomic_bool russianRoulette;
+    std::atomic_bool dynamicResolution;
+    std::atomic<float> frameBudget;
+    std::atomic<float> renderScale;
+    bool showSampleMap = false;
+    std::pair<int, int> reportedWindowSize{0, 0};
 
 public:
     void setNumSamples(int value);
@@ -64,9 +118,27 @@ public:
 
     void setLensRadius(float value);
 
+    void setAdaptiveSampling(bool value);
+
+    void setTargetNoise(float value);
+
+    void setIntegrator(Integrator value);
+
+    void setDenoising(bool value);
+
+    void setRussianRoulette(bool value);
+
+    void setDynamicResolution(bool value);
+
+    void setFrameBudget(float value);
+
+    void setRenderScale(float value);
+
 private:
     void init();
 
+    void uploadImage(const Image &img);
+
     [[nodiscard]] std::pair<int, int> getWindowSize() const {
         int width;
         int height;
@@ -120,6 +192,8 @@ void Gui::init() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);// This is required on WebGL for non power-of-two textures
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);// Same
+
+    glGenBuffers(1, &pixelBuffer);
 }
 
 void Gui::newFrame() {
@@ -129,15 +203,37 @@ void Gui::newFrame() {
 }
 
 void Gui::update() {
+    // The render resolution follows the window, which is left alone while minimized.
+    auto windowSize = getWindowSize();
+    if (windowSize != reportedWindowSize && windowSize.first > 0 && windowSize.second > 0) {
+        reportedWindowSize = windowSize;
+        guiListener->onWindowResized(windowSize.first, windowSize.second);
+    }
+
     auto img = getImage();
 
     if (img != nullptr) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img->width, img->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, img->data);
+        uploadImage(*img);
         auto [width, height] = getWindowSize();
         ImVec2 size(static_cast<float>(width), static_cast<float>(height));
         ImGui::GetBackgroundDrawList()->AddImage((void *) (intptr_t) texture, ImVec2(0, 0), size);
     }
 
+    // Camera navigation over the image: drag to orbit, right-drag to pan, scroll to dolly.
+    const auto &io = ImGui::GetIO();
+    if (!io.WantCaptureMouse) {
+        auto [width, height] = getWindowSize();
+        bool isMoving = io.MouseDelta.x != 0 || io.MouseDelta.y != 0;
+        if (isMoving && ImGui::IsMouseDragging(ImGuiMouseButton_Left)) {
+            guiListener->onOrbit(-io.MouseDelta.x * orbitRadiansPerPixel, io.MouseDelta.y * orbitRadiansPerPixel);
+        } else if (isMoving && ImGui::IsMouseDragging(ImGuiMouseButton_Right)) {
+            guiListener->onPan(-io.MouseDelta.x / std::max(width, 1), io.MouseDelta.y / std::max(height, 1));
+        }
+        if (io.MouseWheel != 0) {
+            guiListener->onDolly(std::pow(dollyFactorPerStep, io.MouseWheel));
+        }
+    }
+
     // render your GUI
     static int counter = 0;
 
@@ -146,38 +242,173 @@ void Gui::update() {
 
     int sliderNumSamples = numSamples;
     if (ImGui::SliderInt("Samples", &sliderNumSamples, 1, 20)) {
-        std::thread t([this, sliderNumSamples]() {
-            guiListener->onSamplesChanged(sliderNumSamples);
-        });
-        t.detach();
+        guiListener->onSamplesChanged(sliderNumSamples);
     }
 
     int sliderMaxDepth = maxDepth;
-    if (ImGui::SliderInt("Max Depth", &sliderMaxDepth, 1, 20)) {
-        std::thread t([this, sliderMaxDepth]() {
-            guiListener->onMaxDepthChanged(sliderMaxDepth);
-        });
-        t.detach();
+    if (ImGui::SliderInt("Max Depth", &sliderMaxDepth, 1, 50)) {
+        guiListener->onMaxDepthChanged(sliderMaxDepth);
+    }
+
+    bool checkboxRussianRoulette = russianRoulette;
+    if (ImGui::Checkbox("Russian Roulette", &checkboxRussianRoulette)) {
+        guiListener->onRussianRouletteChanged(checkboxRussianRoulette);
     }
 
     float sliderLensRadius = lensRadius;
     if (ImGui::SliderFloat("Lens Radius", &sliderLensRadius, 0, 1)) {
-        std::thread t([this, sliderLensRadius]() {
-            guiListener->onLensRadiusChanged(sliderLensRadius);
-        });
-        t.detach();
+        guiListener->onLensRadiusChanged(sliderLensRadius);
+    }
+
+    bool checkboxAdaptiveSampling = adaptiveSampling;
+    if (ImGui::Checkbox("Adaptive Sampling", &checkboxAdaptiveSampling)) {
+        guiListener->onAdaptiveSamplingChanged(checkboxAdaptiveSampling);
+    }
+
+    float sliderTargetNoise = targetNoise;
+    if (ImGui::SliderFloat("Target Noise", &sliderTargetNoise, 0.001f, 0.1f, "%.4f", ImGuiSliderFlags_Logarithmic)) {
+        guiListener->onTargetNoiseChanged(sliderTargetNoise);
+    }
+
+    bool checkboxDenoising = denoising;
+    if (ImGui::Checkbox("Denoise", &checkboxDenoising)) {
+        guiListener->onDenoisingChanged(checkboxDenoising);
+    }
+
+    ImGui::Checkbox("Show Sample Map", &showSampleMap);
+
+    bool checkboxDynamicResolution = dynamicResolution;
+    if (ImGui::Checkbox("Dynamic Resolution", &checkboxDynamicResolution)) {
+        guiListener->onDynamicResolutionChanged(checkboxDynamicResolution);
+    }
+
+    float sliderFrameBudget = frameBudget;
+    if (ImGui::SliderFloat("Frame Budget", &sliderFrameBudget, 10, 500, "%.0f ms", ImGuiSliderFlags_Logarithmic)) {
+        guiListener->onFrameBudgetChanged(sliderFrameBudget);
+    }
+
+    const char *integratorNames[] = {"Recursive", "Wavefront"};
+    int comboIntegrator = static_cast<int>(integrator.load());
+    if (ImGui::Combo("Integrator", &comboIntegrator, integratorNames, IM_ARRAYSIZE(integratorNames))) {
+        guiListener->onIntegratorChanged(static_cast<Integrator>(comboIntegrator));
     }
 
     if (img != nullptr) {
         long long totalRenderTime = img->cumulativeRenderTime.count();
-        long long avgRenderTime = totalRenderTime / img->samples;
+        long long avgRenderTime = totalRenderTime / std::max(img->samples, 1);
         ImGui::Text("Samples: %d Total Render Time: %lld ms (Total), %lld ms (Sample Avg)", img->samples, totalRenderTime, avgRenderTime);
+        ImGui::Text("Resolution: %dx%d (%.0f%% of the window)", img->width, img->height, 100 * renderScale);
+        if (img->previewScale > 1) {
+            ImGui::Text("Preview: 1/%d resolution", img->previewScale);
+        }
+        ImGui::Text("Feedback: %.1f ms after the last change", img->feedbackLatencyMillis);
+        if (img->denoiseMillis > 0) {
+            ImGui::Text("Denoise: %.1f ms per frame", img->denoiseMillis);
+        }
+        InteractionStats interaction;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            interaction = interactionStats;
+        }
+        ImGui::Text("Input: %lld changes in %lld updates, %lld passes discarded (%.0f ms), first frame after %.1f ms",
+                    interaction.commands, interaction.batches, interaction.discardedPasses, interaction.discardedMillis,
+                    interaction.inputLatencyMillis);
+        ImGui::Text("Converged: %.1f%% Average: %.1f spp", 100 * img->convergedFraction, img->averageSamplesPerPixel);
+        const auto &stats = img->schedulerStats;
+        ImGui::Text("Threads: %d Tiles: %.0f tiles/s, %d steals, %.1f%% idle", stats.numThreads, stats.tilesPerSecond(), stats.steals, 100 * stats.idleFraction());
+        ImGui::Text("Upload: %d regions, %.2f MB in %.3f ms (%.0f MB/s)", uploadStats.regions, uploadStats.bytes / 1e6,
+                    uploadStats.time.count() / 1000.0, uploadStats.megabytesPerSecond());
+
+        if (RenderStats::isEnabled) {
+            const auto &renderStats = img->renderStats;
+            const auto &hits = renderStats.hitsByMaterial;
+            double paths = std::max(1LL, renderStats.paths());
+            ImGui::Text("Rays: %.2fM primary, %.2fM secondary, %.2fM shadow, %.1f intersection tests/ray", renderStats.primaryRays / 1e6,
+                        renderStats.secondaryRays / 1e6, renderStats.shadowRays / 1e6, renderStats.intersectionTestsPerRay());
+            ImGui::Text("Hits: %lld lambertian, %lld metal, %lld dielectric, %lld light, %lld other", hits[static_cast<int>(MaterialType::Lambertian)],
+                        hits[static_cast<int>(MaterialType::Metal)], hits[static_cast<int>(MaterialType::Dielectric)],
+                        hits[static_cast<int>(MaterialType::DiffuseLight)], hits[static_cast<int>(MaterialType::Other)]);
+            ImGui::Text("Paths: %.1f%% escaped, %.1f%% absorbed, %.1f%% depth limit, %.1f%% roulette", 100 * renderStats.escaped / paths,
+                        100 * renderStats.absorbed / paths, 100 * renderStats.depthLimited / paths, 100 * renderStats.rouletteEnded / paths);
+
+            std::array<float, RenderStats::maxHistogramBounces + 1> histogram{};
+            int numBuckets = 1;
+            for (int i = 0; i <= RenderStats::maxHistogramBounces; i++) {
+                histogram[i] = static_cast<float>(renderStats.bounceHistogram[i] / paths);
+                if (renderStats.bounceHistogram[i] > 0) {
+                    numBuckets = i + 1;
+                }
+            }
+            ImGui::PlotHistogram("Rays per Path", histogram.data(), numBuckets, 0, nullptr, 0, 1, ImVec2(0, 60));
+        }
     }
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
     ImGui::End();
 }
 
+/**
+ * Copies a new image generation into the display texture through the pixel buffer. When the texture already holds
+ * the previous generation, only the tiles the renderer reports as changed are copied.
+ */
+void Gui::uploadImage(const Image &img) {
+    bool isSampleMap = showSampleMap && !img.sampleMap.empty();
+    bool isSameSize = img.width == textureWidth && img.height == textureHeight;
+    if (isSameSize && img.generation == uploadedGeneration && isSampleMap == isSampleMapUploaded) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto imageBytes = static_cast<GLsizeiptr>(img.width) * img.height * sizeof(int);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+    if (!isSameSize) {
+        // Texture and buffer storage only change with the image size.
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img.width, img.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, imageBytes, nullptr, GL_STREAM_DRAW);
+        textureWidth = img.width;
+        textureHeight = img.height;
+        uploadedGeneration = 0;
+    }
+
+    // The sample map is renormalised every pass, so it is always uploaded whole.
+    bool isIncremental = !isSampleMap && !isSampleMapUploaded && uploadedGeneration != 0 && img.generation == uploadedGeneration + 1;
+    std::vector<Tile> wholeImage = {{0, 0, img.width, img.height}};
+    const auto &regions = isIncremental ? img.changedTiles : wholeImage;
+    const int *pixels = isSampleMap ? img.sampleMap.data() : img.data;
+
+    GLbitfield access = GL_MAP_WRITE_BIT | (isIncremental ? 0 : GL_MAP_INVALIDATE_BUFFER_BIT);
+    auto *mapped = static_cast<int *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, imageBytes, access));
+    long long bytes = 0;
+    if (mapped != nullptr) {
+        // Regions keep their offsets in the buffer, so every glTexSubImage2D reads straight from the image layout.
+        for (const auto &region: regions) {
+            for (int y = region.y0; y < region.y1; y++) {
+                auto offset = y * img.width + region.x0;
+                std::memcpy(mapped + offset, pixels + offset, region.width() * sizeof(int));
+            }
+            bytes += static_cast<long long>(region.numPixels()) * sizeof(int);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, img.width);
+        for (const auto &region: regions) {
+            auto offset = static_cast<intptr_t>(region.y0 * img.width + region.x0) * sizeof(int);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, region.x0, region.y0, region.width(), region.height(), GL_RGBA,
+                            GL_UNSIGNED_BYTE, reinterpret_cast<const void *>(offset));
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    auto end = std::chrono::steady_clock::now();
+
+    uploadedGeneration = mapped != nullptr ? img.generation : 0;
+    isSampleMapUploaded = isSampleMap;
+    uploadStats.bytes = bytes;
+    uploadStats.regions = static_cast<int>(regions.size());
+    uploadStats.time = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+}
+
 void Gui::render() {
     ImGui::EndFrame();
     ImGui::Render();
@@ -215,4 +446,36 @@ void Gui::setLensRadius(float value) {
     lensRadius = value;
 }
 
+void Gui::setAdaptiveSampling(bool value) {
+    adaptiveSampling = value;
+}
+
+void Gui::setTargetNoise(float value) {
+    targetNoise = value;
+}
+
+void Gui::setIntegrator(Integrator value) {
+    integrator = value;
+}
+
+void Gui::setDenoising(bool value) {
+    denoising = value;
+}
+
+void Gui::setRussianRoulette(bool value) {
+    russianRoulette = value;
+}
+
+void Gui::setDynamicResolution(bool value) {
+    dynamicResolution = value;
+}
+
+void Gui::setFrameBudget(float value) {
+    frameBudget = value;
+}
+
+void Gui::setRenderScale(float value) {
+    renderScale = value;
+}
+
 #endif//RAYTRACER_GUI_H
@@ -1,12 +1,25 @@
 #ifndef RAYTRACER_GUI_LISTENER_H
 #define RAYTRACER_GUI_LISTENER_H
 
+#include "renderer.h"
+
 class GuiListener {
 public:
     virtual void onWindowClosing() = 0;
     virtual void onSamplesChanged(int value) = 0;
     virtual void onMaxDepthChanged(int value) = 0;
     virtual void onLensRadiusChanged(double value) = 0;
+    virtual void onAdaptiveSamplingChanged(bool value) = 0;
+    virtual void onTargetNoiseChanged(double value) = 0;
+    virtual void onIntegratorChanged(Integrator value) = 0;
+    virtual void onDenoisingChanged(bool value) = 0;
+    virtual void onRussianRouletteChanged(bool value) = 0;
+    virtual void onOrbit(double yaw, double pitch) = 0;
+    virtual void onPan(double right, double up) = 0;
+    virtual void onDolly(double factor) = 0;
+    virtual void onWindowResized(int width, int height) = 0;
+    virtual void onDynamicResolutionChanged(bool value) = 0;
+    virtual void onFrameBudgetChanged(double millis) = 0;
 };
 
 #endif//RAYTRACER_GUI_LISTENER_H
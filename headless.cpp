@@ -0,0 +1,540 @@
+#include "camera.h"
+#include "checkpoint.h"
+#include "distributed.h"
+#include "image_compare.h"
+#include "image_writer.h"
+#include "renderer.h"
+#include "scene_cache.h"
+#include "scene_file.h"
+#include "scenes.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct HeadlessOptions {
+    int imageWidth = 600;
+    int imageHeight = 400;
+    int samplesPerPixel = 0;// 0: no sample limit
+    double timeBudgetSeconds = 0;// 0: no time limit
+    double targetNoise = 0;// 0: adaptive sampling off
+    int maxDepth = 5;
+    int numThreads = 0;
+    int tileSize = 32;
+    uint64_t seed = 0;
+    uint64_t sceneSeed = 0;
+    Accelerator accelerator = Accelerator::Bvh;
+    Integrator integrator = Integrator::Recursive;
+    bool denoise = false;
+    bool russianRoulette = false;
+    std::string outputPath = "render.png";
+    std::string sampleMapPath;
+    std::string comparePath;
+    double tolerance = 2;
+    std::string statsPath;
+    std::string scenePath;// empty: a built-in scene
+    bool isSmallLightScene = false;// built-in scene: smallLightScene() instead of randomScene()
+    bool useSceneCache = true;
+    std::string writeScenePath;
+    std::string checkpointPath;// empty: no checkpoints
+    double checkpointIntervalSeconds = 60;
+    int numWorkers = 0;   // 0: render in this process
+    bool measureScaling = false;// repeat a --workers render with 1, 2, 4, ... workers
+    int workerFirstSample = 0;
+    bool isWorker = false;// render a sample range for a coordinator and write the accumulation to stdout
+    std::set<std::string> explicitOptions;// options given on the command line, which override the scene file
+};
+
+void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --width <px>          image width (default 600)\n"
+              << "  --height <px>         image height (default 400)\n"
+              << "  --spp <n>             stop after n samples per pixel\n"
+              << "  --time <seconds>      stop after the first pass that exceeds the time budget\n"
+              << "  --noise <level>       sample adaptively and stop once every pixel is below this noise level\n"
+              << "  --max-depth <n>       maximum ray bounces (default 5)\n"
+              << "  --threads <n>         render threads, 0 for all hardware threads (default 0)\n"
+              << "  --tile-size <px>      scheduler tile size (default 32)\n"
+              << "  --seed <n>            sampling seed (default 0)\n"
+              << "  --scene <path>        render a scene file instead of the random scene\n"
+              << "  --scene-cache <on|off> load and write the binary cache <scene>.cache (default on)\n"
+              << "  --write-scene <path>  also save the rendered scene as a scene file\n"
+              << "  --scene-seed <n>      seed of the random scene (default 0)\n"
+              << "  --builtin <random|small-lights> built-in scene rendered without --scene (default random)\n"
+              << "  --checkpoint <path>   save the accumulation periodically and resume from it if it exists\n"
+              << "  --checkpoint-interval <seconds> time between checkpoints (default 60)\n"
+              << "  --workers <n>         split the samples over n worker processes and merge their results\n"
+              << "  --scaling <on|off>    render with 1, 2, 4, ... up to --workers workers and report the speedup (default off)\n"
+              << "  --accel <list|bvh|soa|closed> acceleration structure (default bvh)\n"
+              << "  --integrator <recursive|wavefront> path tracing engine (default recursive)\n"
+              << "  --denoise <on|off>    filter the final image with the feature-guided denoiser (default off)\n"
+              << "  --roulette <on|off>   end paths of low throughput early by Russian roulette (default off)\n"
+              << "  --output <path>       output image, .png or .ppm (default render.png)\n"
+              << "  --sample-map <path>   also write a heat map of the per-pixel sample counts\n"
+              << "  --compare <path>      compare the result against a reference PPM and fail if it differs\n"
+              << "  --tolerance <rmse>    largest accepted RMS difference for --compare, in 8-bit units (default 2)\n"
+              << "  --stats <path>        write the render statistics as JSON\n"
+              << "Without --spp, --time or --noise, 16 samples per pixel are rendered.\n";
+}
+
+bool parseOptions(int argc, char **argv, HeadlessOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        std::string value = argv[++i];
+        options.explicitOptions.insert(arg);
+
+        if (arg == "--width") {
+            options.imageWidth = std::stoi(value);
+        } else if (arg == "--height") {
+            options.imageHeight = std::stoi(value);
+        } else if (arg == "--spp") {
+            options.samplesPerPixel = std::stoi(value);
+        } else if (arg == "--time") {
+            options.timeBudgetSeconds = std::stod(value);
+        } else if (arg == "--noise") {
+            options.targetNoise = std::stod(value);
+        } else if (arg == "--max-depth") {
+            options.maxDepth = std::stoi(value);
+        } else if (arg == "--threads") {
+            options.numThreads = std::stoi(value);
+        } else if (arg == "--tile-size") {
+            options.tileSize = std::stoi(value);
+        } else if (arg == "--seed") {
+            options.seed = std::stoull(value);
+        } else if (arg == "--scene") {
+            options.scenePath = value;
+        } else if (arg == "--scene-cache") {
+            if (value != "on" && value != "off") {
+                std::cerr << "--scene-cache takes on or off\n";
+                return false;
+            }
+            options.useSceneCache = value == "on";
+        } else if (arg == "--write-scene") {
+            options.writeScenePath = value;
+        } else if (arg == "--scene-seed") {
+            options.sceneSeed = std::stoull(value);
+        } else if (arg == "--builtin") {
+            if (value != "random" && value != "small-lights") {
+                std::cerr << "Unknown built-in scene " << value << "\n";
+                return false;
+            }
+            options.isSmallLightScene = value == "small-lights";
+        } else if (arg == "--checkpoint") {
+            options.checkpointPath = value;
+        } else if (arg == "--checkpoint-interval") {
+            options.checkpointIntervalSeconds = std::stod(value);
+        } else if (arg == "--workers") {
+            options.numWorkers = std::stoi(value);
+        } else if (arg == "--scaling") {
+            if (value != "on" && value != "off") {
+                std::cerr << "--scaling takes on or off\n";
+                return false;
+            }
+            options.measureScaling = value == "on";
+        } else if (arg == "--worker-samples") {
+            // Internal: first:count, passed to worker processes by --workers.
+            auto colon = value.find(':');
+            options.workerFirstSample = std::stoi(value.substr(0, colon));
+            options.samplesPerPixel = std::stoi(value.substr(colon + 1));
+            options.isWorker = true;
+            options.explicitOptions.insert("--spp");
+        } else if (arg == "--accel") {
+            if (value == "list") {
+                options.accelerator = Accelerator::List;
+            } else if (value == "bvh") {
+                options.accelerator = Accelerator::Bvh;
+            } else if (value == "soa") {
+                options.accelerator = Accelerator::SphereSoA;
+            } else if (value == "closed") {
+                options.accelerator = Accelerator::Closed;
+            } else {
+                std::cerr << "Unknown accelerator " << value << "\n";
+                return false;
+            }
+        } else if (arg == "--integrator") {
+            if (value == "recursive") {
+                options.integrator = Integrator::Recursive;
+            } else if (value == "wavefront") {
+                options.integrator = Integrator::Wavefront;
+            } else {
+                std::cerr << "Unknown integrator " << value << "\n";
+                return false;
+            }
+        } else if (arg == "--denoise") {
+            if (value != "on" && value != "off") {
+                std::cerr << "--denoise takes on or off\n";
+                return false;
+            }
+            options.denoise = value == "on";
+        } else if (arg == "--roulette") {
+            if (value != "on" && value != "off") {
+                std::cerr << "--roulette takes on or off\n";
+                return false;
+            }
+            options.russianRoulette = value == "on";
+        } else if (arg == "--output" || arg == "-o") {
+            options.outputPath = value;
+        } else if (arg == "--sample-map") {
+            options.sampleMapPath = value;
+        } else if (arg == "--compare") {
+            options.comparePath = value;
+        } else if (arg == "--tolerance") {
+            options.tolerance = std::stod(value);
+        } else if (arg == "--stats") {
+            options.statsPath = value;
+        } else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+    }
+
+    if (options.imageWidth < 2 || options.imageHeight < 2 || options.maxDepth < 1 || options.tileSize < 1) {
+        std::cerr << "Width and height must be at least 2, max depth and tile size at least 1\n";
+        return false;
+    }
+    if (options.numWorkers > 0 && (options.timeBudgetSeconds > 0 || options.targetNoise > 0 || !options.checkpointPath.empty())) {
+        std::cerr << "--workers splits a fixed number of samples and cannot be combined with --time, --noise or --checkpoint\n";
+        return false;
+    }
+    if (options.isWorker && options.samplesPerPixel < 1) {
+        std::cerr << "--worker-samples needs a count of at least 1\n";
+        return false;
+    }
+    if (options.numWorkers > 0 && options.denoise) {
+        // Workers send their accumulation only, without the features that guide the denoiser.
+        std::cerr << "--denoise cannot be combined with --workers\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Takes the render settings of a scene file for every option not given on the command line.
+ */
+void applyRenderSettings(const RenderSettings &settings, HeadlessOptions &options) {
+    auto apply = [&options](const char *option, const std::optional<int> &value, int &target) {
+        if (value && options.explicitOptions.count(option) == 0) {
+            target = *value;
+        }
+    };
+    apply("--width", settings.imageWidth, options.imageWidth);
+    apply("--height", settings.imageHeight, options.imageHeight);
+    apply("--spp", settings.samplesPerPixel, options.samplesPerPixel);
+    apply("--max-depth", settings.maxDepth, options.maxDepth);
+}
+
+/**
+ * Writes the image and the requested side outputs, then runs the comparison.
+ *
+ * @return the process exit code.
+ */
+int writeOutputs(const Image &img, const HeadlessOptions &options) {
+    try {
+        writeImage(img, options.outputPath);
+        if (!options.sampleMapPath.empty()) {
+            writeImage(img.width, img.height, img.sampleMap.data(), options.sampleMapPath);
+        }
+        if (!options.statsPath.empty()) {
+            std::ofstream out(options.statsPath);
+            img.renderStats.writeJson(out);
+            out << "\n";
+            if (!out) {
+                throw std::runtime_error("Failed to write " + options.statsPath);
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    std::cerr << "Wrote " << options.outputPath << "\n";
+
+    if (!options.comparePath.empty()) {
+        try {
+            int refWidth, refHeight;
+            auto reference = readPpm(options.comparePath, refWidth, refHeight);
+            if (refWidth != img.width || refHeight != img.height) {
+                std::cerr << "Reference is " << refWidth << "x" << refHeight << ", expected " << img.width << "x" << img.height << "\n";
+                return 2;
+            }
+            auto difference = compareImages(reference, std::vector<int>(img.data, img.data + img.width * img.height));
+            std::cerr << "Compared with " << options.comparePath << ": RMSE " << difference.rmse << ", max difference "
+                      << difference.maxDifference << ", " << 100 * difference.fractionDifferent << "% of pixels differ\n";
+            if (difference.rmse > options.tolerance) {
+                std::cerr << "RMSE exceeds the tolerance of " << options.tolerance << "\n";
+                return 2;
+            }
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Command line of a worker process: this program with the original options, minus those only the coordinator acts
+ * on. Without --threads, the hardware threads are shared among the workers instead of each starting one per
+ * hardware thread. renderDistributed() appends the sample range.
+ */
+std::vector<std::string> workerCommand(int argc, char **argv, const HeadlessOptions &options, int numWorkers) {
+    static const std::set<std::string> coordinatorOptions = {"--workers", "--scaling", "--write-scene", "--output", "-o",
+                                                             "--sample-map", "--compare", "--tolerance", "--stats"};
+    std::vector<std::string> command = {argv[0]};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (coordinatorOptions.count(argv[i]) == 0) {
+            command.emplace_back(argv[i]);
+            command.emplace_back(argv[i + 1]);
+        }
+    }
+    if (options.explicitOptions.count("--threads") == 0) {
+        int numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / numWorkers);
+        command.emplace_back("--threads");
+        command.push_back(std::to_string(numThreads));
+    }
+    return command;
+}
+
+/**
+ * Identifies everything besides resolution and seed that a checkpoint's samples depend on, so that a checkpoint is
+ * never resumed with another scene or settings.
+ */
+uint64_t checkpointKey(const HeadlessOptions &options) {
+    std::string description = "max depth " + std::to_string(options.maxDepth) + ", noise " + std::to_string(options.targetNoise);
+    if (options.russianRoulette) {
+        description += ", russian roulette";
+    }
+    if (options.scenePath.empty() && options.isSmallLightScene) {
+        description += ", small light scene";
+    } else if (options.scenePath.empty()) {
+        description += ", random scene " + std::to_string(options.sceneSeed);
+    } else {
+        std::ifstream in(options.scenePath, std::ios::binary);
+        description += ", scene " + std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+    return checkpoint_file::hashBytes(description.data(), description.size());
+}
+
+int main(int argc, char **argv) {
+    HeadlessOptions options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Invalid argument: " << e.what() << "\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Scene sceneDescription;
+    try {
+        if (options.scenePath.empty() && options.isSmallLightScene) {
+            sceneDescription = smallLightScene();
+        } else if (options.scenePath.empty()) {
+            sceneDescription.world = randomScene(options.sceneSeed);
+        } else {
+            sceneDescription = loadScene(options.scenePath, options.useSceneCache);
+            applyRenderSettings(sceneDescription.render, options);
+        }
+        if (!options.writeScenePath.empty()) {
+            std::ofstream out(options.writeScenePath);
+            writeScene(out, *sceneDescription.world, sceneDescription.camera, sceneDescription.render, sceneDescription.hasSky);
+            if (!out) {
+                throw std::runtime_error("Failed to write " + options.writeScenePath);
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    if (options.samplesPerPixel <= 0 && options.timeBudgetSeconds <= 0 && options.targetNoise <= 0) {
+        options.samplesPerPixel = 16;
+    }
+    // A worker per sample at most; more would have nothing to render.
+    options.numWorkers = std::min(options.numWorkers, options.samplesPerPixel);
+
+    if (options.numWorkers > 0) {
+        std::vector<int> workerCounts = {options.numWorkers};
+        if (options.measureScaling) {
+            workerCounts.clear();
+            for (int n = 1; n < options.numWorkers; n *= 2) {
+                workerCounts.push_back(n);
+            }
+            workerCounts.push_back(options.numWorkers);
+        }
+        std::shared_ptr<Image> img;
+        try {
+            double singleWorkerRate = 0;// pixel samples per second with one worker, the baseline of the speedup
+            for (int numWorkers: workerCounts) {
+                std::cerr << "Rendering " << options.imageWidth << "x" << options.imageHeight << " with " << numWorkers
+                          << " worker processes\n";
+                auto result = renderDistributed(workerCommand(argc, argv, options, numWorkers), options.samplesPerPixel, numWorkers);
+                Renderer merged(options.imageWidth, options.imageHeight, options.maxDepth, options.seed, 1);
+                merged.restoreCheckpoint(result.accumulation);
+                img = merged.accumulatedImage();
+                std::cerr << "Workers: " << numWorkers << ", wall time " << result.wallSeconds << " s, render time";
+                for (double seconds: result.workerRenderSeconds) {
+                    std::cerr << " " << seconds;
+                }
+                double rate = result.pixelSamplesPerSecond();
+                std::cerr << " s, " << rate / 1e6 << " M pixel samples/s, " << 100 * result.renderFraction()
+                          << "% of worker time rendering";
+                if (numWorkers == 1) {
+                    singleWorkerRate = rate;
+                }
+                if (singleWorkerRate > 0) {
+                    double speedup = rate / singleWorkerRate;
+                    std::cerr << ", speedup " << speedup << ", scaling efficiency " << 100 * speedup / numWorkers << "%";
+                }
+                std::cerr << "\n";
+            }
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+        return writeOutputs(*img, options);
+    }
+
+    auto aspectRatio = static_cast<Real>(options.imageWidth) / options.imageHeight;
+    auto camera = sceneDescription.camera.build(aspectRatio);
+    const auto &bvh = sceneDescription.bvh;
+    std::shared_ptr<Hittable> scene;
+    try {
+        scene = buildAccelerator(sceneDescription.world, options.accelerator, *camera, options.imageWidth,
+                                 options.imageHeight, bvh ? &*bvh : nullptr);
+    } catch (const std::invalid_argument &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    Renderer renderer(options.imageWidth, options.imageHeight, options.maxDepth, options.seed, options.numThreads, options.tileSize);
+    renderer.setIntegrator(options.integrator);
+    renderer.setRussianRoulette(options.russianRoulette);
+    renderer.setLights(Lights(*sceneDescription.world, sceneDescription.hasSky));
+    // Only the final image is denoised, but every pass has to record the features that guide it.
+    renderer.setFeatureTracking(options.denoise);
+    if (options.targetNoise > 0) {
+        renderer.setAdaptiveSampling(true);
+        renderer.setTargetNoise(options.targetNoise);
+    }
+    std::cerr << "Rendering " << options.imageWidth << "x" << options.imageHeight << " on " << renderer.getNumThreads()
+              << " threads in " << (sizeof(Real) == sizeof(float) ? "single" : "double") << " precision\n";
+
+    renderer.setSampleOffset(options.workerFirstSample);
+
+    std::optional<CheckpointWriter> checkpointWriter;
+    uint64_t key = 0;
+    if (!options.checkpointPath.empty()) {
+        key = checkpointKey(options);
+        try {
+            if (auto checkpoint = checkpoint_file::read(options.checkpointPath)) {
+                if (checkpoint->sceneKey != key) {
+                    throw std::runtime_error(options.checkpointPath + " belongs to another scene or other settings");
+                }
+                renderer.restoreCheckpoint(*checkpoint);
+                std::cerr << "Resumed from " << options.checkpointPath << " after " << checkpoint->samplesAccumulated << " passes\n";
+            }
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+        checkpointWriter.emplace(options.checkpointPath, static_cast<size_t>(options.imageWidth) * options.imageHeight);
+    }
+    // Time the render loop spends on checkpoints between passes; the copy itself is done by the workers.
+    double longestCheckpointStallMillis = 0;
+    auto measureStall = [&longestCheckpointStallMillis](std::chrono::steady_clock::time_point stallStart) {
+        auto stall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stallStart).count();
+        longestCheckpointStallMillis = std::max(longestCheckpointStallMillis, stall);
+    };
+
+    auto isFinished = [&options](const Image &img, double elapsed) {
+        bool reachedSamples = options.samplesPerPixel > 0 && img.samples >= options.samplesPerPixel;
+        bool reachedTime = options.timeBudgetSeconds > 0 && elapsed >= options.timeBudgetSeconds;
+        bool reachedNoise = options.targetNoise > 0 && img.convergedFraction >= 1;
+        return reachedSamples || reachedTime || reachedNoise;
+    };
+
+    // A resumed render may already be finished, in which case its image is written without another pass.
+    std::shared_ptr<Image> img = renderer.getSamplesAccumulated() > 0 ? renderer.accumulatedImage() : nullptr;
+    auto start = std::chrono::steady_clock::now();
+    auto lastCheckpoint = start;
+    auto elapsedSeconds = [start]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+    while (!img || !isFinished(*img, elapsedSeconds())) {
+        if (checkpointWriter && std::chrono::duration<double>(std::chrono::steady_clock::now() - lastCheckpoint).count()
+                                        >= options.checkpointIntervalSeconds) {
+            // Wait for the buffers of the previous checkpoint rather than allocating new ones in the render loop.
+            auto stallStart = std::chrono::steady_clock::now();
+            if (auto buffer = checkpointWriter->takeBuffer()) {
+                renderer.requestCheckpoint(std::move(*buffer));
+                lastCheckpoint = std::chrono::steady_clock::now();
+            }
+            measureStall(stallStart);
+        }
+        img = renderer.render(*camera, *scene);
+        if (checkpointWriter) {
+            auto stallStart = std::chrono::steady_clock::now();
+            if (auto checkpoint = renderer.takeCheckpoint()) {
+                checkpoint->sceneKey = key;
+                checkpointWriter->submit(std::move(*checkpoint));
+            }
+            measureStall(stallStart);
+        }
+        if (!options.isWorker) {
+            std::cerr << "\rPasses: " << img->samples << ", " << img->averageSamplesPerPixel << " spp, "
+                      << 100 * img->convergedFraction << "% converged (" << elapsedSeconds() << " s)" << std::flush;
+        }
+    }
+    if (options.isWorker) {
+        // The coordinator reads the accumulation from the pipe on standard output.
+        auto checkpoint = renderer.saveCheckpoint();
+        std::vector<char> encoded(checkpoint_file::encodedSize(checkpoint));
+        checkpoint_file::encode(checkpoint, encoded.data());
+        bool isWritten = std::fwrite(encoded.data(), 1, encoded.size(), stdout) == encoded.size() && std::fflush(stdout) == 0;
+        return isWritten ? 0 : 1;
+    }
+    std::cerr << "\n";
+    if (checkpointWriter) {
+        // The final state is saved at once, since no workers are waiting for it.
+        auto checkpoint = renderer.saveCheckpoint();
+        checkpoint.sceneKey = key;
+        checkpointWriter->submit(std::move(checkpoint));
+        checkpointWriter->wait();
+        std::cerr << "Checkpoints: " << checkpointWriter->getNumWritten() << " written to " << options.checkpointPath
+                  << ", longest render stall " << longestCheckpointStallMillis << " ms, last write "
+                  << checkpointWriter->getLastWriteMillis() << " ms in the background\n";
+    }
+
+    const auto &stats = img->schedulerStats;
+    long long totalRenderTime = img->cumulativeRenderTime.count();
+    std::cerr << "Render time: " << totalRenderTime << " ms (" << totalRenderTime / img->samples << " ms per pass), "
+              << "last pass " << stats.tilesPerSecond() << " tiles/s, " << 100 * stats.idleFraction() << "% idle\n";
+    if (RenderStats::isEnabled) {
+        const auto &renderStats = img->renderStats;
+        std::cerr << "Rays: " << renderStats.primaryRays << " primary, " << renderStats.secondaryRays << " secondary, "
+                  << renderStats.shadowRays << " shadow, "
+                  << renderStats.intersectionTestsPerRay() << " intersection tests per ray, "
+                  << renderStats.rays() / 1e3 / std::max(1LL, static_cast<long long>(totalRenderTime)) << " Mrays/s\n";
+    }
+    if (options.denoise) {
+        renderer.setDenoising(true);
+        img = renderer.accumulatedImage();
+        std::cerr << "Denoise time: " << img->denoiseMillis << " ms\n";
+    }
+
+    return writeOutputs(*img, options);
+}
@@ -1,29 +1,55 @@
 #ifndef RAYTRACER_HIT_RECORD_H
 #define RAYTRACER_HIT_RECORD_H
 
-#include "material.h"
 #include "ray.h"
-#include <memory>
 #include <optional>
 
+class Hittable;
+class Material;
+
+/**
+ * Closest hit found so far while a ray is tested against the scene. Kept small so that candidate hits which are
+ * later rejected cost no more than a distance compare; the full HitRecord is built only for the final hit.
+ */
+struct Intersection {
+    Real t;
+    const Hittable *object;// primitive that resolves the hit
+    int index;             // primitive within object, for containers that hold several
+    const Hittable *instance = nullptr;// instance whose transform places object in the world, if any
+};
+
+/**
+ * Shading information of a hit. The material is a non-owning handle into the scene, so copying a record never
+ * touches a reference count.
+ */
 struct HitRecord {
     Point3 p;
     Vec3 normal;
-    double t;
+    Real t;
     bool isFrontFace;
-    std::shared_ptr<Material> material;
+    const Material *material;
 
-    static HitRecord build(const Ray &r, const Point3 &p, const Vec3 &outwardNormal, double t, const std::shared_ptr<Material> &m) {
+    static HitRecord build(const Ray &r, const Point3 &p, const Vec3 &outwardNormal, Real t, const Material *m) {
         bool isFrontFace = dot(r.direction(), outwardNormal) < 0;
         Vec3 normal = isFrontFace ? outwardNormal : -outwardNormal;
         return {p, normal, t, isFrontFace, m};
     }
 
-    HitRecord(const Point3 &p, const Vec3 &normal, double t, bool isFrontFace, const std::shared_ptr<Material> &m) : p(p),
-                                                                                                                     normal(normal),
-                                                                                                                     t(t),
-                                                                                                                     isFrontFace(isFrontFace),
-                                                                                                                     material(m) {}
+    HitRecord(const Point3 &p, const Vec3 &normal, Real t, bool isFrontFace, const Material *m) : p(p),
+                                                                                                    normal(normal),
+                                                                                                    t(t),
+                                                                                                    isFrontFace(isFrontFace),
+                                                                                                    material(m) {}
+};
+
+/**
+ * What a camera sample sees first, which guides the Denoiser. A sample that escapes sees the sky: its colour as
+ * albedo, a zero normal and depth 0. Also used for sums of features over several samples.
+ */
+struct SampleFeatures {
+    Color albedo;
+    Vec3 normal;
+    Real depth;// ray parameter of the first hit
 };
 
 #endif//RAYTRACER_HIT_RECORD_H
@@ -1,6 +1,7 @@
 #ifndef RAYTRACER_HITTABLE_H
 #define RAYTRACER_HITTABLE_H
 
+#include "aabb.h"
 #include "hit_record.h"
 #include "ray.h"
 #include <memory>
@@ -10,7 +11,36 @@ struct HitRecord;
 
 class Hittable {
 public:
-    [[nodiscard]] virtual std::optional<HitRecord> hit(const Ray &r, double tMin, double tMax) const = 0;
+    virtual ~Hittable() = default;
+
+    /**
+     * Finds the closest hit in [tMin, tMax] without computing any shading information.
+     */
+    [[nodiscard]] virtual std::optional<Intersection> intersect(const Ray &r, Real tMin, Real tMax) const = 0;
+
+    /**
+     * Builds the full record of an intersection returned by intersect(). Containers forward to the primitive
+     * stored in the intersection.
+     */
+    [[nodiscard]] virtual HitRecord resolve(const Ray &r, const Intersection &intersection) const = 0;
+
+    /**
+     * Builds the record of an intersection found by any Hittable, through the instance that holds the primitive
+     * if there is one.
+     */
+    [[nodiscard]] static HitRecord resolveHit(const Ray &r, const Intersection &intersection) {
+        return (intersection.instance != nullptr ? intersection.instance : intersection.object)->resolve(r, intersection);
+    }
+
+    [[nodiscard]] std::optional<HitRecord> hit(const Ray &r, Real tMin, Real tMax) const {
+        auto intersection = intersect(r, tMin, tMax);
+        if (!intersection) {
+            return {};
+        }
+        return resolveHit(r, *intersection);
+    }
+
+    [[nodiscard]] virtual Aabb boundingBox() const = 0;
 };
 
 #endif//RAYTRACER_HITTABLE_H
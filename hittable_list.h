@@ -19,20 +19,32 @@ public:
 
     void add(const shared_ptr<Hittable> &object) { objects.push_back(object); }
 
-    [[nodiscard]] std::optional<HitRecord> hit(const Ray &r, double tMin, double tMax) const override;
+    [[nodiscard]] std::optional<Intersection> intersect(const Ray &r, Real tMin, Real tMax) const override;
+
+    [[nodiscard]] HitRecord resolve(const Ray &r, const Intersection &intersection) const override {
+        return resolveHit(r, intersection);
+    }
+
+    [[nodiscard]] Aabb boundingBox() const override {
+        Aabb box;
+        for (const auto &object: objects) {
+            box.expand(object->boundingBox());
+        }
+        return box;
+    }
 
 public:
     std::vector<shared_ptr<Hittable>> objects;
 };
 
-std::optional<HitRecord> HittableList::hit(const Ray &r, double tMin, double tMax) const {
-    std::optional<HitRecord> result;
+std::optional<Intersection> HittableList::intersect(const Ray &r, Real tMin, Real tMax) const {
+    std::optional<Intersection> result;
     auto nearestHitDist = tMax;
 
     for (const auto &object: objects) {
-        if (auto rec = object->hit(r, tMin, nearestHitDist)) {
-            nearestHitDist = rec->t;
-            result = rec;
+        if (auto intersection = object->intersect(r, tMin, nearestHitDist)) {
+            nearestHitDist = intersection->t;
+            result = intersection;
         }
     }
 
@@ -1,7 +1,10 @@
 #ifndef RAYTRACER_IMAGE_H
 #define RAYTRACER_IMAGE_H
 
+#include "render_stats.h"
+#include "tile_scheduler.h"
 #include <chrono>
+#include <vector>
 
 class Image {
 public:
@@ -10,6 +13,16 @@ public:
     int samples;
     std::chrono::milliseconds cumulativeRenderTime;
     int *data;
+    TileScheduler::Stats schedulerStats;
+    RenderStats renderStats;// totals since the last reset
+    double convergedFraction = 0;
+    double averageSamplesPerPixel = 0;
+    std::vector<int> sampleMap;// per-pixel sample counts as a heat map, same layout as data
+    unsigned long long generation = 0;// increases by one with every image a renderer produces
+    std::vector<Tile> changedTiles;// regions whose pixels differ from the previous generation
+    int previewScale = 1;// > 1: a preview with one sample per block of previewScale x previewScale pixels
+    double feedbackLatencyMillis = 0;// from the renderer's last reset to its first image after it
+    double denoiseMillis = 0;// time spent denoising this image, 0 if it was not denoised
 
     Image(int width, int height, int samples, int *data,
           std::chrono::milliseconds cumulativeRenderTime) : width(width), height(height),
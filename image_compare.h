@@ -0,0 +1,79 @@
+#ifndef RAYTRACER_IMAGE_COMPARE_H
+#define RAYTRACER_IMAGE_COMPARE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Per-channel difference between two 8-bit images.
+ */
+struct ImageDifference {
+    double rmse = 0;      // root mean square over all channels, in 8-bit units
+    int maxDifference = 0;// largest absolute difference of any channel
+    double fractionDifferent = 0;// fraction of pixels with any channel differing by more than one unit
+};
+
+/**
+ * Reads a binary (P6) PPM with a maxval of 255 into packed 0xAABBGGRR pixels, top row first.
+ * Throws std::runtime_error if the file cannot be read.
+ */
+std::vector<int> readPpm(const std::string &path, int &width, int &height) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Unable to open " + path + " for reading");
+    }
+
+    std::string magic;
+    int maxValue;
+    in >> magic >> width >> height >> maxValue;
+    in.get();// single whitespace byte before the raster
+    if (!in || magic != "P6" || maxValue != 255 || width <= 0 || height <= 0) {
+        throw std::runtime_error(path + " is not an 8-bit binary PPM");
+    }
+
+    std::vector<unsigned char> raster(3 * static_cast<size_t>(width) * height);
+    in.read(reinterpret_cast<char *>(raster.data()), static_cast<std::streamsize>(raster.size()));
+    if (!in) {
+        throw std::runtime_error(path + " is truncated");
+    }
+
+    std::vector<int> pixels(static_cast<size_t>(width) * height);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = (255 << 24) | (raster[3 * i + 2] << 16) | (raster[3 * i + 1] << 8) | raster[3 * i];
+    }
+    return pixels;
+}
+
+ImageDifference compareImages(const std::vector<int> &a, const std::vector<int> &b) {
+    if (a.size() != b.size()) {
+        throw std::invalid_argument("Images differ in size");
+    }
+
+    ImageDifference difference;
+    double sumSquared = 0;
+    size_t numDifferent = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        int pixelMax = 0;
+        for (int shift = 0; shift < 24; shift += 8) {
+            int d = std::abs(((a[i] >> shift) & 0xff) - ((b[i] >> shift) & 0xff));
+            sumSquared += d * d;
+            pixelMax = std::max(pixelMax, d);
+        }
+        difference.maxDifference = std::max(difference.maxDifference, pixelMax);
+        if (pixelMax > 1) {
+            numDifferent++;
+        }
+    }
+    if (!a.empty()) {
+        difference.rmse = std::sqrt(sumSquared / (3.0 * a.size()));
+        difference.fractionDifferent = static_cast<double>(numDifferent) / a.size();
+    }
+    return difference;
+}
+
+#endif//RAYTRACER_IMAGE_COMPARE_H
@@ -0,0 +1,145 @@
+#ifndef RAYTRACER_IMAGE_WRITER_H
+#define RAYTRACER_IMAGE_WRITER_H
+
+#include "image.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Writes packed 0xAABBGGRR pixels, top row first, as a binary (P6) PPM.
+ */
+void writePpm(int width, int height, const int *pixels, std::ostream &out) {
+    out << "P6\n"
+        << width << ' ' << height << "\n255\n";
+    std::vector<char> row(3 * width);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int pixel = pixels[y * width + x];
+            row[3 * x] = static_cast<char>(pixel & 0xff);
+            row[3 * x + 1] = static_cast<char>((pixel >> 8) & 0xff);
+            row[3 * x + 2] = static_cast<char>((pixel >> 16) & 0xff);
+        }
+        out.write(row.data(), static_cast<std::streamsize>(row.size()));
+    }
+}
+
+/**
+ * Writes packed 0xAABBGGRR pixels, top row first, as an 8-bit RGB PNG. The pixel data is stored in
+ * uncompressed deflate blocks, which keeps the encoder dependency free at the cost of file size.
+ */
+void writePng(int width, int height, const int *pixels, std::ostream &out) {
+    static const std::array<uint32_t, 256> crcTable = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        return table;
+    }();
+
+    auto putUInt32 = [](std::vector<uint8_t> &bytes, uint32_t value) {
+        bytes.push_back(value >> 24);
+        bytes.push_back(value >> 16);
+        bytes.push_back(value >> 8);
+        bytes.push_back(value);
+    };
+
+    auto writeChunk = [&](const char *type, const std::vector<uint8_t> &payload) {
+        std::vector<uint8_t> chunk;
+        putUInt32(chunk, static_cast<uint32_t>(payload.size()));
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), payload.begin(), payload.end());
+        uint32_t crc = 0xffffffffu;
+        for (size_t i = 4; i < chunk.size(); i++) {
+            crc = crcTable[(crc ^ chunk[i]) & 0xff] ^ (crc >> 8);
+        }
+        putUInt32(chunk, crc ^ 0xffffffffu);
+        out.write(reinterpret_cast<const char *>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+    };
+
+    // Scanlines, each prefixed with filter type 0.
+    std::vector<uint8_t> raw;
+    raw.reserve((3 * width + 1) * height);
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        for (int x = 0; x < width; x++) {
+            int pixel = pixels[y * width + x];
+            raw.push_back(pixel & 0xff);
+            raw.push_back((pixel >> 8) & 0xff);
+            raw.push_back((pixel >> 16) & 0xff);
+        }
+    }
+
+    // zlib stream made of stored deflate blocks.
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    const size_t maxBlockSize = 65535;
+    for (size_t offset = 0;; offset += maxBlockSize) {
+        auto size = static_cast<uint16_t>(std::min(maxBlockSize, raw.size() - offset));
+        auto invertedSize = static_cast<uint16_t>(~size);
+        bool isLast = offset + size >= raw.size();
+        zlib.push_back(isLast ? 1 : 0);
+        zlib.push_back(size & 0xff);
+        zlib.push_back(size >> 8);
+        zlib.push_back(invertedSize & 0xff);
+        zlib.push_back(invertedSize >> 8);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+        if (isLast) {
+            break;
+        }
+    }
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (auto byte: raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    putUInt32(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> header;
+    putUInt32(header, width);
+    putUInt32(header, height);
+    header.insert(header.end(), {8, 2, 0, 0, 0});// 8 bit RGB, default compression, filter and interlace
+
+    const char signature[] = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n'};
+    out.write(signature, sizeof(signature));
+    writeChunk("IHDR", header);
+    writeChunk("IDAT", zlib);
+    writeChunk("IEND", {});
+}
+
+/**
+ * Writes packed pixels to disk, as PNG if the path ends in ".png" and as PPM otherwise.
+ */
+void writeImage(int width, int height, const int *pixels, const std::string &path) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Unable to open " + path + " for writing");
+    }
+
+    auto endsWith = [&path](const std::string &suffix) {
+        return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    if (endsWith(".png") || endsWith(".PNG")) {
+        writePng(width, height, pixels, out);
+    } else {
+        writePpm(width, height, pixels, out);
+    }
+
+    if (!out) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+void writeImage(const Image &image, const std::string &path) {
+    writeImage(image.width, image.height, image.data, path);
+}
+
+#endif//RAYTRACER_IMAGE_WRITER_H
@@ -0,0 +1,62 @@
+#ifndef RAYTRACER_INSTANCE_H
+#define RAYTRACER_INSTANCE_H
+
+#include "hit_record.h"
+#include "hittable.h"
+#include "transform.h"
+#include <memory>
+#include <optional>
+#include <stdexcept>
+
+/**
+ * A shared prototype placed in the world by an affine transform. Rays are moved into the prototype's space
+ * instead of the prototype being copied, so an instance costs one transform and a box however large the
+ * prototype is.
+ *
+ * Instances form the top level of a two-level hierarchy: a Bvh over instances, each pointing at a prototype with
+ * its own hierarchy (e.g. a TriangleMesh or a Bvh over a HittableList). Prototypes must not contain instances.
+ */
+class Instance : public Hittable {
+public:
+    Instance(const std::shared_ptr<Hittable> &prototype, const Transform &objectToWorld)
+        : prototype(prototype), worldToObject(objectToWorld.inverse()), bounds(objectToWorld.applyToBox(prototype->boundingBox())) {
+        if (std::dynamic_pointer_cast<Instance>(prototype)) {
+            throw std::invalid_argument("Instances cannot be nested");
+        }
+    }
+
+    [[nodiscard]] std::optional<Intersection> intersect(const Ray &r, Real tMin, Real tMax) const override {
+        // The direction is not renormalized, so distances along the object space ray equal those in the world.
+        auto intersection = prototype->intersect(toObject(r), tMin, tMax);
+        if (intersection) {
+            intersection->instance = this;
+        }
+        return intersection;
+    }
+
+    [[nodiscard]] HitRecord resolve(const Ray &r, const Intersection &intersection) const override {
+        auto rec = intersection.object->resolve(toObject(r), intersection);
+        rec.p = r.at(rec.t);
+        rec.normal = unitVector(worldToObject.applyTransposedToVector(rec.normal));
+        return rec;
+    }
+
+    [[nodiscard]] Aabb boundingBox() const override {
+        return bounds;
+    }
+
+    [[nodiscard]] const std::shared_ptr<Hittable> &getPrototype() const {
+        return prototype;
+    }
+
+private:
+    std::shared_ptr<Hittable> prototype;
+    Transform worldToObject;// only the inverse is kept; normals use its transpose
+    Aabb bounds;            // of the transformed prototype, in world space
+
+    [[nodiscard]] Ray toObject(const Ray &r) const {
+        return {worldToObject.applyToPoint(r.origin()), worldToObject.applyToVector(r.direction())};
+    }
+};
+
+#endif//RAYTRACER_INSTANCE_H
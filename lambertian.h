@@ -4,12 +4,12 @@
 #include "hit_record.h"
 #include "material.h"
 
-class Lambertian: public Material {
+class Lambertian final : public Material {
 public:
-    explicit Lambertian(const Color &albedo) : Material(albedo) {}
+    explicit Lambertian(const Color &albedo) : Material(MaterialType::Lambertian, albedo) {}
 
-    [[nodiscard]] std::optional<Ray> scatter(const Ray &r, const HitRecord &rec) const override {
-        auto scatterDirection = rec.normal + randomUnitVector();
+    [[nodiscard]] std::optional<Ray> scatter(const Ray &r, const HitRecord &rec, Rng &rng) const override {
+        auto scatterDirection = rec.normal + randomUnitVector(rng);
         // Catch degenerate scatter direction
         if (scatterDirection.isNearZero()) {
             scatterDirection = rec.normal;
@@ -17,6 +17,18 @@ public:
         auto scattered = Ray(rec.p, scatterDirection);
         return scattered;
     }
+
+    /**
+     * The normal plus a random unit vector is cosine distributed about the normal.
+     */
+    [[nodiscard]] Real pdf(const Ray &r, const HitRecord &rec, const Vec3 &direction) const override {
+        auto cosine = dot(rec.normal, unitVector(direction));
+        return cosine > 0 ? static_cast<Real>(cosine / pi) : 0;
+    }
+
+    [[nodiscard]] bool isSpecular() const override {
+        return false;
+    }
 };
 
 
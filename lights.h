@@ -0,0 +1,200 @@
+#ifndef RAYTRACER_LIGHTS_H
+#define RAYTRACER_LIGHTS_H
+
+#include "color.h"
+#include "hit_record.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "rng.h"
+#include "sphere.h"
+#include "util.h"
+#include "vec3.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <optional>
+#include <vector>
+
+/**
+ * What lights a scene: the sky, unless the scene turns it off, and the emitting spheres of the world.
+ *
+ * At every bounce off a material that is not specular, the integrators sample a direction towards the spheres
+ * (next-event estimation) and trace a shadow ray along it, besides scattering as usual. Light found by either ray
+ * is weighted by the power heuristic of the two densities, so each direction counts once in total and mostly
+ * through the strategy that finds it more easily: the shadow ray for small lights, the scattered ray for large
+ * lights seen from glossy surfaces. Other emitters, e.g. meshes, and the sky are only found by scattered rays.
+ */
+class Lights {
+public:
+    /**
+     * A shadow ray and what the light it finds is weighted with.
+     */
+    struct ShadowRay {
+        Ray ray;
+        Color weight;
+    };
+
+    /**
+     * The sky alone, as in scenes without emitters.
+     */
+    Lights() = default;
+
+    Lights(const HittableList &world, bool hasSky) : isSkyLit(hasSky) {
+        for (const auto &object: world.objects) {
+            auto sphere = std::dynamic_pointer_cast<Sphere>(object);
+            if (sphere && sphere->getMaterial()->getType() == MaterialType::DiffuseLight) {
+                spheres.push_back({sphere->getCenter(), sphere->getRadius()});
+            }
+        }
+    }
+
+    /**
+     * Radiance of the sky seen by a ray that escapes the scene.
+     */
+    [[nodiscard]] Color sky(const Vec3 &direction) const {
+        return isSkyLit ? skyColor(direction) : Color(0, 0, 0);
+    }
+
+    [[nodiscard]] bool hasSky() const {
+        return isSkyLit;
+    }
+
+    /**
+     * Number of lights that are sampled directly.
+     */
+    [[nodiscard]] int size() const {
+        return static_cast<int>(spheres.size());
+    }
+
+    /**
+     * Samples a shadow ray from the hit rec of r towards a light. Call after the material has scattered, so the
+     * same random numbers are drawn in the same order by every integrator.
+     *
+     * @param material of rec, as its concrete class if the caller knows it, so its calls are resolved statically.
+     * @return nothing if there are no lights, the material is specular or the direction is one the material never
+     * scatters into.
+     */
+    template<typename M = Material>
+    [[nodiscard]] std::optional<ShadowRay> sampleShadowRay(const Ray &r, const HitRecord &rec, Rng &rng, const M &material) const {
+        if (spheres.empty() || material.isSpecular()) {
+            return {};
+        }
+        auto direction = sampleDirection(rec.p, rng);
+        if (!direction) {
+            return {};
+        }
+        Real materialPdf = material.pdf(r, rec, *direction);
+        if (materialPdf <= 0) {
+            return {};
+        }
+        // albedo * materialPdf is the BRDF times cosine, divided by the density of the light sample.
+        double lightPdf = pdf(rec.p, *direction);
+        if (lightPdf <= 0) {
+            return {};// sampled on the rim of the cone, and rounded outside
+        }
+        auto weight = static_cast<Real>(powerHeuristic(lightPdf, materialPdf) / lightPdf * materialPdf);
+        return ShadowRay{Ray(rec.p, *direction), material.getAlbedo() * weight};
+    }
+
+    [[nodiscard]] std::optional<ShadowRay> sampleShadowRay(const Ray &r, const HitRecord &rec, Rng &rng) const {
+        return sampleShadowRay(r, rec, rng, *rec.material);
+    }
+
+    /**
+     * Weight of the light that the ray scattered from the hit rec of r finds.
+     */
+    template<typename M = Material>
+    [[nodiscard]] Real emissionWeight(const Ray &r, const HitRecord &rec, const Ray &scattered, const M &material) const {
+        if (spheres.empty() || material.isSpecular()) {
+            return 1;
+        }
+        return static_cast<Real>(powerHeuristic(material.pdf(r, rec, scattered.direction()), pdf(rec.p, scattered.direction())));
+    }
+
+    [[nodiscard]] Real emissionWeight(const Ray &r, const HitRecord &rec, const Ray &scattered) const {
+        return emissionWeight(r, rec, scattered, *rec.material);
+    }
+
+    /**
+     * Density per unit solid angle with which lights are sampled in direction from p.
+     */
+    [[nodiscard]] double pdf(const Point3 &p, const Vec3 &direction) const {
+        auto unitDirection = unitVector(direction);
+        double sum = 0;
+        for (const auto &sphere: spheres) {
+            if (auto cone = coneTowards(sphere, p)) {
+                if (dot(unitDirection, cone->axis) >= cone->cosThetaMax) {
+                    sum += 1 / (2 * pi * cone->oneMinusCosThetaMax);
+                }
+            }
+        }
+        return sum / static_cast<double>(spheres.size());
+    }
+
+private:
+    struct SphereLight {
+        Point3 center;
+        Real radius;
+    };
+
+    /**
+     * Directions from a point outside a sphere that hit it.
+     */
+    struct Cone {
+        Vec3 axis;// unit vector towards the centre
+        Real cosThetaMax;
+        double oneMinusCosThetaMax;// without the cancellation of computing it from cosThetaMax
+    };
+
+    std::vector<SphereLight> spheres;
+    bool isSkyLit = true;
+
+    static double powerHeuristic(double pdf, double otherPdf) {
+        return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+    }
+
+    /**
+     *
+     * @return nothing if p lies inside the sphere.
+     */
+    static std::optional<Cone> coneTowards(const SphereLight &sphere, const Point3 &p) {
+        auto toCenter = sphere.center - p;
+        auto distanceSquared = toCenter.lengthSquared();
+        auto radiusSquared = sphere.radius * sphere.radius;
+        if (distanceSquared <= radiusSquared) {
+            return {};
+        }
+        double sinThetaMaxSquared = radiusSquared / distanceSquared;
+        double cosThetaMax = std::sqrt(1 - sinThetaMaxSquared);
+        return Cone{toCenter / std::sqrt(distanceSquared), static_cast<Real>(cosThetaMax), sinThetaMaxSquared / (1 + cosThetaMax)};
+    }
+
+    /**
+     * Picks a sphere uniformly and a direction uniformly within the cone of directions from p that hit it.
+     */
+    std::optional<Vec3> sampleDirection(const Point3 &p, Rng &rng) const {
+        auto index = std::min(static_cast<size_t>(randomDouble(rng) * spheres.size()), spheres.size() - 1);
+        auto u = randomDouble(rng);
+        auto v = randomDouble(rng);
+        auto cone = coneTowards(spheres[index], p);
+        if (!cone) {
+            return {};
+        }
+        double oneMinusCosTheta = u * cone->oneMinusCosThetaMax;
+        double cosTheta = 1 - oneMinusCosTheta;
+        double sinTheta = std::sqrt(std::max(0.0, oneMinusCosTheta * (2 - oneMinusCosTheta)));
+        double phi = 2 * pi * v;
+
+        // Orthonormal basis about the axis (Duff et al., 2017).
+        const auto &w = cone->axis;
+        Real sign = std::copysign(Real(1), w.z());
+        Real a = -1 / (sign + w.z());
+        Real b = w.x() * w.y() * a;
+        Vec3 tangent(1 + sign * w.x() * w.x() * a, sign * b, -sign * w.x());
+        Vec3 bitangent(b, sign + w.y() * w.y() * a, -w.y());
+        return static_cast<Real>(sinTheta * std::cos(phi)) * tangent + static_cast<Real>(sinTheta * std::sin(phi)) * bitangent
+               + static_cast<Real>(cosTheta) * w;
+    }
+};
+
+#endif//RAYTRACER_LIGHTS_H
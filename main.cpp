@@ -1,92 +1,49 @@
 #include "camera.h"
-#include "dielectric.h"
 #include "gui.h"
-#include "hittable.h"
-#include "hittable_list.h"
-#include "lambertian.h"
-#include "metal.h"
-#include "ray.h"
 #include "render_manager.h"
 #include "renderer.h"
-#include "sphere.h"
-#include "util.h"
+#include "scene_cache.h"
+#include "scenes.h"
 #include <iostream>
 #include <thread>
 
-#define M_PI 3.14159265359
-
-std::shared_ptr<HittableList> randomScene() {
-    std::shared_ptr<HittableList> world = std::make_shared<HittableList>();
-
-    auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
-    world->add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
-
-    for (int a = -11; a < 11; a++) {
-        for (int b = -11; b < 11; b++) {
-            auto chooseMat = randomDouble();
-            Point3 center(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
-
-            if ((center - Point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<Material> sphereMaterial;
-
-                if (chooseMat < 0.8) {
-                    // diffuse
-                    auto albedo = Color::random() * Color::random();
-                    sphereMaterial = make_shared<Lambertian>(albedo);
-                    world->add(make_shared<Sphere>(center, 0.2, sphereMaterial));
-                } else if (chooseMat < 0.95) {
-                    // metal
-                    auto albedo = Color::random(0.5, 1);
-                    auto fuzz = randomDouble(0, 0.5);
-                    sphereMaterial = make_shared<Metal>(albedo, fuzz);
-                    world->add(make_shared<Sphere>(center, 0.2, sphereMaterial));
-                } else {
-                    // glass
-                    sphereMaterial = make_shared<Dielectric>(1.5);
-                    world->add(make_shared<Sphere>(center, 0.2, sphereMaterial));
-                }
-            }
+int main(int argc, char **argv) {
+    // World, from the scene file given as the only argument or the random scene
+    Scene sceneDescription;
+    if (argc > 1) {
+        try {
+            sceneDescription = loadScene(argv[1]);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return 1;
         }
+    } else {
+        sceneDescription.world = randomScene();
     }
+    auto world = sceneDescription.world;
 
-    auto material1 = make_shared<Dielectric>(1.5);
-    world->add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
-
-    auto material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-    world->add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
-
-    auto material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
-    world->add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
-
-    return world;
-}
-
-int main() {
-    // Image
+    // Image, at its initial resolution: the render manager resizes the renderer to the window
     const int samplesPerPixel = 1;
-    const int maxDepth = 5;
-    auto imageWidth = 600;
-    auto imageHeight = 400;
-    double aspectRatio = static_cast<double>(imageWidth) / imageHeight;
-
-    // World
-    auto world = randomScene();
+    const int maxDepth = sceneDescription.render.maxDepth.value_or(5);
+    const auto accelerator = Accelerator::Bvh;
+    auto imageWidth = sceneDescription.render.imageWidth.value_or(600);
+    auto imageHeight = sceneDescription.render.imageHeight.value_or(400);
+    auto aspectRatio = static_cast<Real>(imageWidth) / imageHeight;
 
     // Camera
-    auto origin = Point3(13, 2, 3);
-    auto lookAt = Point3(0, 0, 0);
-    auto lookDir = lookAt - origin;
-    auto verticalDir = Point3(0, 1, 0);
-
-    auto roll = 0 * M_PI / 180;
-    auto vFov = 20 * M_PI / 180;
-    auto aperture = 0.1;
-    auto focusDist = 10.0;
+    std::shared_ptr<Camera> camera = sceneDescription.camera.build(aspectRatio);
 
     std::shared_ptr<Renderer> renderer = std::make_shared<Renderer>(imageWidth, imageHeight, maxDepth);
-    std::shared_ptr<Camera> camera = std::make_shared<Camera>(origin, lookDir, roll, vFov, aspectRatio, aperture, focusDist);
+    renderer->setProgressivePreview(true);
+    renderer->setDepthTracking(true);
+    renderer->setLights(Lights(*world, sceneDescription.hasSky));
+
+    // Acceleration structure
+    const auto &bvh = sceneDescription.bvh;
+    auto scene = buildAccelerator(world, accelerator, *camera, imageWidth, imageHeight, bvh ? &*bvh : nullptr);
+
     std::shared_ptr<Gui> gui = std::make_shared<Gui>();
-    std::shared_ptr<RenderManager> renderManager = std::make_shared<RenderManager>(renderer, camera, world, gui);
+    std::shared_ptr<RenderManager> renderManager = std::make_shared<RenderManager>(renderer, camera, scene, gui);
     gui->setListener(renderManager);
     gui->run();
 
@@ -0,0 +1,200 @@
+#ifndef RAYTRACER_MAPPED_FILE_H
+#define RAYTRACER_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Read-only memory mapping of a whole file. isOpen() is false if the file could not be mapped.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            return;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            return;
+        }
+        data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        size = data != nullptr ? static_cast<size_t>(fileSize.QuadPart) : 0;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info {};
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                data = static_cast<const char *>(address);
+                size = static_cast<size_t>(info.st_size);
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (data != nullptr) {
+            munmap(const_cast<char *>(data), size);
+        }
+#endif
+    }
+
+    [[nodiscard]] bool isOpen() const {
+        return data != nullptr;
+    }
+
+    [[nodiscard]] const char *getData() const {
+        return data;
+    }
+
+    [[nodiscard]] size_t getSize() const {
+        return size;
+    }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+/**
+ * Read-write shared mapping of a file that is created, or truncated, with the given size. isOpen() is false if the
+ * file could not be created or mapped. Writes reach the file when flush() succeeds or, at the latest, when the
+ * mapping is closed.
+ */
+class WritableMappedFile {
+public:
+    WritableMappedFile(const std::string &path, size_t size) : size(size) {
+        if (size == 0) {
+            return;
+        }
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        auto size64 = static_cast<unsigned long long>(size);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32),
+                                     static_cast<DWORD>(size64 & 0xffffffff), nullptr);
+        if (mapping == nullptr) {
+            return;
+        }
+        data = static_cast<char *>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+#else
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return;
+        }
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            return;
+        }
+        void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address != MAP_FAILED) {
+            data = static_cast<char *>(address);
+        }
+#endif
+    }
+
+    WritableMappedFile(const WritableMappedFile &) = delete;
+
+    WritableMappedFile &operator=(const WritableMappedFile &) = delete;
+
+    ~WritableMappedFile() {
+#ifdef _WIN32
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (data != nullptr) {
+            munmap(data, size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    [[nodiscard]] bool isOpen() const {
+        return data != nullptr;
+    }
+
+    [[nodiscard]] char *getData() const {
+        return data;
+    }
+
+    [[nodiscard]] size_t getSize() const {
+        return size;
+    }
+
+    /**
+     * Blocks until the mapped contents are on disk.
+     */
+    bool flush() {
+        if (data == nullptr) {
+            return false;
+        }
+#ifdef _WIN32
+        return FlushViewOfFile(data, 0) && FlushFileBuffers(file);
+#else
+        return msync(data, size, MS_SYNC) == 0;
+#endif
+    }
+
+private:
+    char *data = nullptr;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+#endif//RAYTRACER_MAPPED_FILE_H
@@ -2,29 +2,84 @@
 #define RAYTRACER_MATERIAL_H
 
 #include "hit_record.h"
-#include "hittable.h"
-#include "material.h"
 #include "ray.h"
 #include <optional>
 
 struct HitRecord;
 
+/**
+ * Built-in material kinds, used to group hits by material and to call the built-in materials without virtual
+ * dispatch, see visitMaterial(). Materials defined elsewhere report Other.
+ */
+enum class MaterialType {
+    Lambertian,
+    Metal,
+    Dielectric,
+    DiffuseLight,
+    Other
+};
+
+/**
+ * A surface scatters a hit ray into a random direction, and the light that ray brings back is weighted by the albedo.
+ * So the BRDF times cosine of a material is its albedo times pdf(), the density of that direction.
+ */
 class Material {
 public:
     explicit Material(const Color &albedo) : albedo(albedo) {}
 
-    [[nodiscard]] virtual std::optional<Ray> scatter(const Ray &r, const HitRecord &rec) const = 0;
+    [[nodiscard]] virtual std::optional<Ray> scatter(const Ray &r, const HitRecord &rec, Rng &rng) const = 0;
+
+    /**
+     * Density per unit solid angle with which scatter() sends the hit of r into direction, which need not be a unit
+     * vector. Only meaningful if the material is not specular.
+     */
+    [[nodiscard]] virtual Real pdf(const Ray &r, const HitRecord &rec, const Vec3 &direction) const {
+        return 0;
+    }
+
+    /**
+     * Whether scatter() picks from a few exact directions, e.g. a mirror, so that no other direction, such as one
+     * towards a light, has a density. Materials that do not implement pdf() count as specular.
+     */
+    [[nodiscard]] virtual bool isSpecular() const {
+        return true;
+    }
+
+    /**
+     * Not virtual: the type is a tag set by the built-in materials, so reading it costs no indirect call.
+     */
+    [[nodiscard]] MaterialType getType() const {
+        return type;
+    }
 
     [[nodiscard]] const Color &getAlbedo() const {
         return albedo;
     }
 
+    [[nodiscard]] const Color &getEmission() const {
+        return emission;
+    }
+
+    /**
+     * Radiance the surface emits towards the ray of rec. Surfaces only emit from their front face.
+     */
+    [[nodiscard]] Color emitted(const HitRecord &rec) const {
+        return rec.isFrontFace ? emission : Color(0, 0, 0);
+    }
+
 protected:
     Color albedo;
+    Color emission;
+
+    Material(MaterialType type, const Color &albedo, const Color &emission = Color(0, 0, 0))
+        : albedo(albedo), emission(emission), type(type) {}
 
     static inline Vec3 reflect(const Vec3 &v, const Vec3 &n) {
         return v - 2 * dot(v, n) * n;
     }
+
+private:
+    MaterialType type = MaterialType::Other;
 };
 
 #endif//RAYTRACER_MATERIAL_H
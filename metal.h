@@ -3,15 +3,17 @@
 
 #include "hit_record.h"
 #include "material.h"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 
-class Metal : public Material {
+class Metal final : public Material {
 public:
-    explicit Metal(const Color &albedo, double f) : Material(albedo), fuzz(f) {}
+    explicit Metal(const Color &albedo, Real f) : Material(MaterialType::Metal, albedo), fuzz(f) {}
 
-    [[nodiscard]] std::optional<Ray> scatter(const Ray &r, const HitRecord &rec) const override {
+    [[nodiscard]] std::optional<Ray> scatter(const Ray &r, const HitRecord &rec, Rng &rng) const override {
         Vec3 reflected = reflect(unitVector(r.direction()), rec.normal);
-        auto scattered = Ray(rec.p, reflected + fuzz * randomInUnitSphere());
+        auto scattered = Ray(rec.p, reflected + fuzz * randomInUnitSphere(rng));
 
         if (dot(scattered.direction(), rec.normal) > 0) {
             return scattered;
@@ -20,8 +22,41 @@ public:
         return {};
     }
 
+    /**
+     * The scattered direction ends at a uniform point of the ball of radius fuzz around the tip of the unit
+     * reflection, so its density is that of the ball integrated along the direction: (t1^3 - t0^3) / (4 pi fuzz^3)
+     * for the part [t0, t1] of the direction's line that lies inside the ball.
+     */
+    [[nodiscard]] Real pdf(const Ray &r, const HitRecord &rec, const Vec3 &direction) const override {
+        auto unitDirection = unitVector(direction);
+        if (dot(unitDirection, rec.normal) <= 0) {
+            return 0;// absorbed
+        }
+        Vec3 reflected = reflect(unitVector(r.direction()), rec.normal);
+        auto halfB = dot(unitDirection, reflected);
+        auto discriminant = halfB * halfB - reflected.lengthSquared() + fuzz * fuzz;
+        if (discriminant <= 0) {
+            return 0;
+        }
+        auto sqrtd = std::sqrt(discriminant);
+        auto t0 = std::max<Real>(halfB - sqrtd, 0);
+        auto t1 = halfB + sqrtd;
+        if (t1 <= 0) {
+            return 0;
+        }
+        return static_cast<Real>((t1 * t1 * t1 - t0 * t0 * t0) / (4 * pi * fuzz * fuzz * fuzz));
+    }
+
+    [[nodiscard]] bool isSpecular() const override {
+        return fuzz <= 0;
+    }
+
+    [[nodiscard]] Real getFuzz() const {
+        return fuzz;
+    }
+
 private:
-    double fuzz;
+    Real fuzz;
 };
 
 #endif//RAYTRACER_METAL_H
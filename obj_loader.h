@@ -0,0 +1,177 @@
+#ifndef RAYTRACER_OBJ_LOADER_H
+#define RAYTRACER_OBJ_LOADER_H
+
+#include "triangle_mesh.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * What loading an OBJ file took.
+ */
+struct ObjLoadStats {
+    long long vertices = 0;
+    long long normals = 0;
+    long long triangles = 0;
+    double parseMilliseconds = 0;
+    double bvhMilliseconds = 0;
+    size_t meshBytes = 0;// memory held by the finished mesh
+};
+
+/**
+ * Loads the geometry of a Wavefront OBJ file into a TriangleMesh with a single material.
+ *
+ * Only v, vn and f statements are used; faces with more than three vertices are split into fans, and negative
+ * (relative) indices are supported. The file is streamed twice, one line at a time: the first pass counts the
+ * vertices, normals and triangles so that the second pass can fill buffers of exactly the final size. Peak memory
+ * is therefore the mesh itself plus the temporary arrays of its BVH build, independent of the file size.
+ *
+ * Throws std::runtime_error naming the offending line.
+ */
+std::shared_ptr<TriangleMesh> loadObj(const std::string &path, const std::shared_ptr<Material> &material,
+                                      ObjLoadStats *stats = nullptr) {
+    auto start = std::chrono::steady_clock::now();
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+
+    auto isStatement = [](const std::string &line, const char *keyword, size_t length) {
+        return line.compare(0, length, keyword) == 0 && line.size() > length && (line[length] == ' ' || line[length] == '\t');
+    };
+    auto countFaceVertices = [](const std::string &line) {
+        int count = 0;
+        for (size_t i = 1; i < line.size(); i++) {
+            if (line[i] != ' ' && line[i] != '\t' && line[i] != '\r' && (line[i - 1] == ' ' || line[i - 1] == '\t')) {
+                count++;
+            }
+        }
+        return count;
+    };
+
+    std::string line;
+    size_t numPositions = 0;
+    size_t numNormals = 0;
+    size_t numTriangles = 0;
+    while (std::getline(in, line)) {
+        if (isStatement(line, "v", 1)) {
+            numPositions++;
+        } else if (isStatement(line, "vn", 2)) {
+            numNormals++;
+        } else if (isStatement(line, "f", 1)) {
+            numTriangles += std::max(countFaceVertices(line) - 2, 0);
+        }
+    }
+
+    TriangleMesh::Buffers buffers;
+    buffers.positions.reserve(numPositions);
+    buffers.normals.reserve(numNormals);
+    buffers.indices.reserve(3 * numTriangles);
+    if (numNormals > 0) {
+        buffers.normalIndices.reserve(3 * numTriangles);
+    }
+
+    in.clear();
+    in.seekg(0);
+    int lineNumber = 0;
+    std::vector<int> faceIndices;
+    std::vector<int> faceNormalIndices;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        auto fail = [&](const std::string &message) {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": " + message);
+        };
+
+        const char *cursor = line.c_str();
+        auto readReal = [&]() {
+            char *end;
+            double value = std::strtod(cursor, &end);
+            if (end == cursor) {
+                fail("expected a number");
+            }
+            cursor = end;
+            return static_cast<Real>(value);
+        };
+        // Resolves a 1-based or negative (relative) OBJ index against the number of elements read so far.
+        auto readIndex = [&](size_t numElements) {
+            char *end;
+            long value = std::strtol(cursor, &end, 10);
+            if (end == cursor || value == 0 || (value > 0 && static_cast<size_t>(value) > numElements)
+                || (value < 0 && static_cast<size_t>(-value) > numElements)) {
+                fail("invalid index");
+            }
+            cursor = end;
+            return static_cast<int>(value > 0 ? value - 1 : static_cast<long>(numElements) + value);
+        };
+
+        if (isStatement(line, "v", 1)) {
+            cursor += 1;
+            auto x = readReal();
+            auto y = readReal();
+            auto z = readReal();
+            buffers.positions.emplace_back(x, y, z);
+        } else if (isStatement(line, "vn", 2)) {
+            cursor += 2;
+            auto x = readReal();
+            auto y = readReal();
+            auto z = readReal();
+            buffers.normals.emplace_back(x, y, z);
+        } else if (isStatement(line, "f", 1)) {
+            cursor += 1;
+            faceIndices.clear();
+            faceNormalIndices.clear();
+            while (true) {
+                while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r') {
+                    cursor++;
+                }
+                if (*cursor == '\0' || *cursor == '#') {
+                    break;
+                }
+                // v, v/vt, v//vn or v/vt/vn
+                faceIndices.push_back(readIndex(buffers.positions.size()));
+                int normalIndex = -1;
+                if (*cursor == '/') {
+                    cursor++;
+                    while ((*cursor >= '0' && *cursor <= '9') || *cursor == '-') {
+                        cursor++;// texture coordinates are not used
+                    }
+                    if (*cursor == '/') {
+                        cursor++;
+                        normalIndex = readIndex(buffers.normals.size());
+                    }
+                }
+                faceNormalIndices.push_back(normalIndex);
+            }
+            if (faceIndices.size() < 3) {
+                fail("a face needs at least three vertices");
+            }
+            for (size_t i = 1; i + 1 < faceIndices.size(); i++) {
+                for (size_t corner: {size_t(0), i, i + 1}) {
+                    buffers.indices.push_back(faceIndices[corner]);
+                    if (numNormals > 0) {
+                        buffers.normalIndices.push_back(faceNormalIndices[corner]);
+                    }
+                }
+            }
+        }
+    }
+    auto parsed = std::chrono::steady_clock::now();
+
+    auto mesh = std::make_shared<TriangleMesh>(std::move(buffers), material);
+    if (stats) {
+        stats->vertices = mesh->getVertexCount();
+        stats->normals = static_cast<long long>(numNormals);
+        stats->triangles = mesh->getTriangleCount();
+        stats->parseMilliseconds = std::chrono::duration<double, std::milli>(parsed - start).count();
+        stats->bvhMilliseconds = mesh->getBuildTime().count() / 1000.0;
+        stats->meshBytes = mesh->memoryFootprint();
+    }
+    return mesh;
+}
+
+#endif//RAYTRACER_OBJ_LOADER_H
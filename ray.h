@@ -3,24 +3,27 @@
 
 #include "vec3.h"
 
-class Ray {
+template<typename T>
+class RayT {
 public:
-    Ray() = default;
+    RayT() = default;
 
-    Ray(const Point3 &origin, const Vec3 &direction)
+    RayT(const Vec3T<T> &origin, const Vec3T<T> &direction)
         : orig(origin), dir(direction) {}
 
-    [[nodiscard]] Point3 origin() const { return orig; }
+    [[nodiscard]] Vec3T<T> origin() const { return orig; }
 
-    [[nodiscard]] Vec3 direction() const { return dir; }
+    [[nodiscard]] Vec3T<T> direction() const { return dir; }
 
-    [[nodiscard]] Point3 at(double t) const {
+    [[nodiscard]] Vec3T<T> at(T t) const {
         return orig + t * dir;
     }
 
 private:
-    Point3 orig;
-    Vec3 dir;
+    Vec3T<T> orig;
+    Vec3T<T> dir;
 };
 
+using Ray = RayT<Real>;
+
 #endif//RAYTRACER_RAY_H
@@ -1,69 +1,241 @@
 #ifndef RAYTRACER_RENDER_MANAGER_H
 #define RAYTRACER_RENDER_MANAGER_H
 
+#include "camera.h"
+#include "dynamic_resolution.h"
 #include "gui.h"
 #include "gui_listener.h"
+#include "hittable.h"
+#include "renderer.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
+/**
+ * Drives the renderer for the GUI. GUI callbacks only queue commands; the render thread applies them between
+ * passes, so the renderer's settings and accumulation are never changed while a pass is running. Commands for the
+ * same parameter replace each other while queued, so dragging a slider costs one update per pass at most, however
+ * many events it sends. Commands that invalidate the accumulation interrupt the running pass, which the renderer
+ * then discards as stale.
+ *
+ * The render resolution follows the window. With dynamic resolution on, it is scaled down or up after each pass
+ * so that passes take about the frame budget, see DynamicResolution, and the accumulation is resampled to the new
+ * resolution rather than discarded.
+ */
 class RenderManager : public GuiListener {
 private:
+    enum class Parameter {
+        Samples,
+        MaxDepth,
+        LensRadius,
+        AdaptiveSampling,
+        TargetNoise,
+        Integrator,
+        Denoising,
+        RussianRoulette,
+        Camera,
+        WindowSize,
+        DynamicResolution,
+        FrameBudget
+    };
+
+    /**
+     * Camera movement received since the last camera command was applied. Movements add up instead of replacing
+     * each other.
+     */
+    struct CameraMotion {
+        double yaw = 0;
+        double pitch = 0;
+        double panRight = 0;
+        double panUp = 0;
+        double dollyFactor = 1;
+    };
+
+    struct Command {
+        Parameter parameter;
+        std::function<void()> apply;// runs on the render thread between passes
+    };
+
     std::shared_ptr<Camera> camera;
     std::shared_ptr<Renderer> renderer;
-    std::shared_ptr<HittableList> scene;
+    std::shared_ptr<Hittable> scene;
     std::shared_ptr<Gui> gui;
 
-    std::atomic_int numSamplesRequired = 1;
-    bool hasWork = true;
+    int numSamplesRequired = 1;// only used by the render thread
+    bool needsPass = true;     // only used by the render thread
     bool isExiting = false;
+    std::vector<Command> commands;// at most one per parameter, in the order they first arrived
+    std::chrono::steady_clock::time_point firstCommandTime;// of the oldest queued command
+    CameraMotion pendingMotion;
+    Gui::InteractionStats stats;
+    DynamicResolution dynamicResolution;// only used by the render thread, like the window size
+    bool isDynamicResolution = true;
+    int windowWidth;
+    int windowHeight;
 
     std::condition_variable cond;
     std::mutex mutex;
 
     std::thread thread = std::thread([this]() {
-        while (!isExiting) {
-            std::unique_lock<std::mutex> lock(mutex);
-            cond.wait(lock, [this] { return hasWork || isExiting; });
-            lock.unlock();
+        std::chrono::steady_clock::time_point inputTime;
+        bool isAwaitingFrame = false;
+        while (true) {
+            std::vector<Command> batch;
+            unsigned long long epoch;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this] { return !commands.empty() || needsPass || isExiting; });
+                if (isExiting) {
+                    break;
+                }
+                batch.swap(commands);
+                // Any later command interrupts the renderer and so makes a pass with this epoch stale.
+                epoch = renderer->getEpoch();
+                if (!batch.empty()) {
+                    // Latency counts from the oldest input that no frame has reflected yet.
+                    if (!isAwaitingFrame) {
+                        inputTime = firstCommandTime;
+                        isAwaitingFrame = true;
+                    }
+                    stats.batches++;
+                }
+            }
 
-            if (isExiting) {
-                break;
+            if (!batch.empty()) {
+                for (const auto &command: batch) {
+                    command.apply();
+                }
+                needsPass = renderer->getSamplesAccumulated() < numSamplesRequired;
+                if (!needsPass) {
+                    isAwaitingFrame = false;
+                    continue;
+                }
             }
 
-            auto img = renderer->render(*camera, *scene);
+            auto start = std::chrono::steady_clock::now();
+            auto img = renderer->render(*camera, *scene, epoch);
+            auto end = std::chrono::steady_clock::now();
 
             if (!img) {
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.discardedPasses++;
+                stats.discardedMillis += std::chrono::duration<double, std::milli>(end - start).count();
+                gui->setInteractionStats(stats);
                 continue;
             }
 
             gui->setImage(img);
+            // Previews are cheaper than full passes and say nothing about their cost.
+            double passMillis = std::chrono::duration<double, std::milli>(end - start).count();
+            if (isDynamicResolution && img->previewScale == 1 && dynamicResolution.update(passMillis)) {
+                resizeRender();
+            }
 
-            if (renderer->getSamplesAccumulated() >= numSamplesRequired) {
-                lock.lock();
-                hasWork = false;
-                lock.unlock();
+            bool isConverged = renderer->isAdaptiveSampling() && img->convergedFraction >= 1;
+            needsPass = renderer->getSamplesAccumulated() < numSamplesRequired && !isConverged;
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.completedPasses++;
+            if (isAwaitingFrame) {
+                stats.inputLatencyMillis = std::chrono::duration<double, std::milli>(end - inputTime).count();
+                isAwaitingFrame = false;
             }
+            gui->setInteractionStats(stats);
         }
     });
 
-    void beginRendering() {
-        std::unique_lock<std::mutex> lock(mutex);
-        hasWork = true;
-        lock.unlock();
+    /**
+     * Queues apply, replacing a queued command for the same parameter.
+     *
+     * @param isInvalidating whether the command discards the accumulation, so the running pass is wasted work.
+     */
+    void post(Parameter parameter, bool isInvalidating, std::function<void()> apply) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.commands++;
+            if (commands.empty()) {
+                firstCommandTime = std::chrono::steady_clock::now();
+            }
+            auto queued = std::find_if(commands.begin(), commands.end(),
+                                       [parameter](const Command &command) { return command.parameter == parameter; });
+            if (queued != commands.end()) {
+                queued->apply = std::move(apply);
+            } else {
+                commands.push_back({parameter, std::move(apply)});
+            }
+            if (isInvalidating) {
+                renderer->interrupt();
+            }
+        }
         cond.notify_one();
     }
 
-    void stopRendering() {
-        std::unique_lock<std::mutex> lock(mutex);
-        hasWork = false;
-        lock.unlock();
-        cond.notify_one();
+    /**
+     * Adds to the pending camera motion and queues a command that applies all of it.
+     */
+    template<typename Update>
+    void postCameraMotion(Update update) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            update(pendingMotion);
+        }
+        post(Parameter::Camera, true, [this] { moveCamera(); });
+    }
+
+    /**
+     * Applies the pending camera motion and reprojects the accumulation into the new view, which is shown at once.
+     * Runs on the render thread.
+     */
+    void moveCamera() {
+        CameraMotion motion;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::swap(motion, pendingMotion);
+        }
+        Camera previous(*camera);
+        camera->orbit(static_cast<Real>(motion.yaw), static_cast<Real>(motion.pitch));
+        camera->pan(static_cast<Real>(motion.panRight), static_cast<Real>(motion.panUp));
+        camera->dolly(static_cast<Real>(motion.dollyFactor));
+        gui->setImage(renderer->reproject(previous, *camera));
+    }
+
+    /**
+     * Resizes the renderer to the window at the current render scale, resampling its accumulation, and shows the
+     * result. Runs on the render thread.
+     */
+    void resizeRender() {
+        auto [width, height] = dynamicResolution.renderSize(windowWidth, windowHeight);
+        if (auto img = renderer->resize(width, height)) {
+            gui->setImage(img);
+        }
+        gui->setRenderScale(static_cast<float>(dynamicResolution.getScale()));
+    }
+
+    /**
+     * Takes a new window size. A new shape changes the view, so the accumulation is discarded; a new size alone
+     * only resamples it. Runs on the render thread.
+     */
+    void resizeWindow(int width, int height) {
+        bool isSameShape = width * windowHeight == height * windowWidth;
+        windowWidth = width;
+        windowHeight = height;
+        if (!isSameShape) {
+            renderer->reset();
+            camera->setAspectRatio(static_cast<Real>(width) / height);
+        }
+        resizeRender();
     }
 
     void shutdown() {
-        std::unique_lock<std::mutex> lock(mutex);
-        hasWork = false;
-        isExiting = true;
-        lock.unlock();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isExiting = true;
+            renderer->interrupt();
+        }
         cond.notify_all();
         if (thread.joinable()) {
             thread.join();
@@ -71,16 +243,30 @@ private:
     }
 
 public:
-    RenderManager(const shared_ptr<Renderer> &renderer,
-                  const shared_ptr<Camera> &camera,
-                  const shared_ptr<HittableList> &scene,
-                  const shared_ptr<Gui> &gui) : renderer(renderer),
-                                                camera(camera),
-                                                scene(scene),
-                                                gui(gui) {
+    RenderManager(const std::shared_ptr<Renderer> &renderer,
+                  const std::shared_ptr<Camera> &camera,
+                  const std::shared_ptr<Hittable> &scene,
+                  const std::shared_ptr<Gui> &gui) : renderer(renderer),
+                                                     camera(camera),
+                                                     scene(scene),
+                                                     gui(gui),
+                                                     windowWidth(renderer->getImageWidth()),
+                                                     windowHeight(renderer->getImageHeight()) {
         gui->setNumSamples(numSamplesRequired);
         gui->setMaxDepth(renderer->getMaxDepth());
         gui->setLensRadius(camera->getLensRadius());
+        gui->setAdaptiveSampling(renderer->isAdaptiveSampling());
+        gui->setTargetNoise(static_cast<float>(renderer->getTargetNoise()));
+        gui->setIntegrator(renderer->getIntegrator());
+        gui->setDenoising(renderer->isDenoising());
+        gui->setRussianRoulette(renderer->isRussianRoulette());
+        gui->setDynamicResolution(isDynamicResolution);
+        gui->setFrameBudget(static_cast<float>(dynamicResolution.getBudget()));
+        gui->setRenderScale(static_cast<float>(dynamicResolution.getScale()));
+    }
+
+    ~RenderManager() {
+        shutdown();
     }
 
     void onWindowClosing() override {
@@ -88,41 +274,108 @@ public:
     }
 
     void onSamplesChanged(int value) override {
-        if (renderer->getSamplesAccumulated() > value) {
-            renderer->interrupt();
-            stopRendering();
-            renderer->reset();
-            numSamplesRequired = value;
-            beginRendering();
-        } else if (renderer->getSamplesAccumulated() < value) {
-            stopRendering();
-            numSamplesRequired = value;
-            beginRendering();
-        } else {
-            renderer->interrupt();
-            stopRendering();
+        // The running pass would overshoot a limit at or below the samples already accumulated.
+        post(Parameter::Samples, renderer->getSamplesAccumulated() >= value, [this, value] {
+            if (renderer->getSamplesAccumulated() > value) {
+                renderer->reset();
+            }
             numSamplesRequired = value;
-        }
+        });
         gui->setNumSamples(value);
     }
 
     void onMaxDepthChanged(int value) override {
-        renderer->interrupt();
-        stopRendering();
-        renderer->reset();
-        renderer->setMaxDepth(value);
-        beginRendering();
+        post(Parameter::MaxDepth, true, [this, value] {
+            renderer->reset();
+            renderer->setMaxDepth(value);
+        });
         gui->setMaxDepth(value);
     }
 
     void onLensRadiusChanged(double value) override {
-        renderer->interrupt();
-        stopRendering();
-        renderer->reset();
-        camera->setLensRadius(value);
-        beginRendering();
+        post(Parameter::LensRadius, true, [this, value] {
+            renderer->reset();
+            camera->setLensRadius(value);
+        });
         gui->setLensRadius(value);
     }
+
+    void onAdaptiveSamplingChanged(bool value) override {
+        // Converged pixels keep their samples, so toggling only changes where the next passes spend them.
+        post(Parameter::AdaptiveSampling, false, [this, value] { renderer->setAdaptiveSampling(value); });
+        gui->setAdaptiveSampling(value);
+    }
+
+    void onTargetNoiseChanged(double value) override {
+        post(Parameter::TargetNoise, false, [this, value] { renderer->setTargetNoise(value); });
+        gui->setTargetNoise(static_cast<float>(value));
+    }
+
+    void onOrbit(double yaw, double pitch) override {
+        postCameraMotion([yaw, pitch](CameraMotion &motion) {
+            motion.yaw += yaw;
+            motion.pitch += pitch;
+        });
+    }
+
+    void onPan(double right, double up) override {
+        postCameraMotion([right, up](CameraMotion &motion) {
+            motion.panRight += right;
+            motion.panUp += up;
+        });
+    }
+
+    void onDolly(double factor) override {
+        postCameraMotion([factor](CameraMotion &motion) { motion.dollyFactor *= factor; });
+    }
+
+    void onIntegratorChanged(Integrator value) override {
+        post(Parameter::Integrator, true, [this, value] {
+            renderer->reset();
+            renderer->setIntegrator(value);
+        });
+        gui->setIntegrator(value);
+    }
+
+    void onDenoisingChanged(bool value) override {
+        // Only the display changes, so the accumulation is shown again at once instead of waiting for a pass.
+        post(Parameter::Denoising, false, [this, value] {
+            renderer->setDenoising(value);
+            if (renderer->getSamplesAccumulated() > 0) {
+                gui->setImage(renderer->accumulatedImage());
+            }
+        });
+        gui->setDenoising(value);
+    }
+
+    void onRussianRouletteChanged(bool value) override {
+        post(Parameter::RussianRoulette, true, [this, value] {
+            renderer->reset();
+            renderer->setRussianRoulette(value);
+        });
+        gui->setRussianRoulette(value);
+    }
+
+    void onWindowResized(int width, int height) override {
+        post(Parameter::WindowSize, true, [this, width, height] { resizeWindow(width, height); });
+    }
+
+    void onDynamicResolutionChanged(bool value) override {
+        // Turning it off goes back to the full window resolution.
+        post(Parameter::DynamicResolution, false, [this, value] {
+            isDynamicResolution = value;
+            if (!value) {
+                dynamicResolution.setScale(DynamicResolution::maxScale);
+                resizeRender();
+            }
+        });
+        gui->setDynamicResolution(value);
+    }
+
+    void onFrameBudgetChanged(double millis) override {
+        post(Parameter::FrameBudget, false, [this, millis] { dynamicResolution.setBudget(millis); });
+        gui->setFrameBudget(static_cast<float>(millis));
+    }
 };
 
 #endif//RAYTRACER_RENDER_MANAGER_H
@@ -0,0 +1,139 @@
+#ifndef RAYTRACER_RENDER_STATS_H
+#define RAYTRACER_RENDER_STATS_H
+
+#include "material.h"
+#include <algorithm>
+#include <array>
+#include <ostream>
+
+/**
+ * RAYTRACER_STAT(statement) runs statement only when render statistics are compiled in, which is the default.
+ * Building with RAYTRACER_NO_RENDER_STATS removes every counter update.
+ */
+#ifdef RAYTRACER_NO_RENDER_STATS
+#define RAYTRACER_STAT(statement)
+#else
+#define RAYTRACER_STAT(statement) statement
+#endif
+
+/**
+ * Counters describing the work done by the path tracer.
+ */
+struct RenderStats {
+#ifdef RAYTRACER_NO_RENDER_STATS
+    static constexpr bool isEnabled = false;
+#else
+    static constexpr bool isEnabled = true;
+#endif
+    static constexpr int numMaterialTypes = static_cast<int>(MaterialType::Other) + 1;
+    static constexpr int maxHistogramBounces = 32;// longer paths are counted in the last bucket
+
+    long long primaryRays = 0;
+    long long secondaryRays = 0;
+    long long shadowRays = 0;      // towards lights, see Lights
+    long long intersectionTests = 0;// ray-primitive tests
+    std::array<long long, numMaterialTypes> hitsByMaterial{};
+    long long escaped = 0;   // paths that left the scene
+    long long absorbed = 0;  // paths whose material did not scatter
+    long long depthLimited = 0;// paths cut off at the maximum depth
+    long long rouletteEnded = 0;// paths ended by Russian roulette
+    std::array<long long, maxHistogramBounces + 1> bounceHistogram{};// paths by number of rays traced
+
+    [[nodiscard]] long long rays() const {
+        return primaryRays + secondaryRays + shadowRays;
+    }
+
+    [[nodiscard]] double intersectionTestsPerRay() const {
+        return rays() > 0 ? static_cast<double>(intersectionTests) / rays() : 0;
+    }
+
+    [[nodiscard]] long long paths() const {
+        return escaped + absorbed + depthLimited + rouletteEnded;
+    }
+
+    void countRay(int bounce) {
+        (bounce <= 1 ? primaryRays : secondaryRays)++;
+    }
+
+    void countShadowRay() {
+        shadowRays++;
+    }
+
+    void countHit(const Material &material) {
+        hitsByMaterial[static_cast<int>(material.getType())]++;
+    }
+
+    // numRays is the number of rays the path traced before it ended.
+
+    void countEscaped(int numRays) {
+        escaped++;
+        countPathLength(numRays);
+    }
+
+    void countAbsorbed(int numRays) {
+        absorbed++;
+        countPathLength(numRays);
+    }
+
+    void countDepthLimited(int numRays, long long numPaths = 1) {
+        depthLimited += numPaths;
+        countPathLength(numRays, numPaths);
+    }
+
+    void countRouletteEnded(int numRays) {
+        rouletteEnded++;
+        countPathLength(numRays);
+    }
+
+    void merge(const RenderStats &other) {
+        primaryRays += other.primaryRays;
+        secondaryRays += other.secondaryRays;
+        shadowRays += other.shadowRays;
+        intersectionTests += other.intersectionTests;
+        for (int i = 0; i < numMaterialTypes; i++) {
+            hitsByMaterial[i] += other.hitsByMaterial[i];
+        }
+        escaped += other.escaped;
+        absorbed += other.absorbed;
+        depthLimited += other.depthLimited;
+        rouletteEnded += other.rouletteEnded;
+        for (int i = 0; i <= maxHistogramBounces; i++) {
+            bounceHistogram[i] += other.bounceHistogram[i];
+        }
+    }
+
+    void writeJson(std::ostream &out) const {
+        out << "{\"primary_rays\": " << primaryRays << ", \"secondary_rays\": " << secondaryRays
+            << ", \"shadow_rays\": " << shadowRays
+            << ", \"intersection_tests\": " << intersectionTests
+            << ", \"intersection_tests_per_ray\": " << intersectionTestsPerRay()
+            << ", \"hits\": {\"lambertian\": " << hitsByMaterial[static_cast<int>(MaterialType::Lambertian)]
+            << ", \"metal\": " << hitsByMaterial[static_cast<int>(MaterialType::Metal)]
+            << ", \"dielectric\": " << hitsByMaterial[static_cast<int>(MaterialType::Dielectric)]
+            << ", \"diffuse_light\": " << hitsByMaterial[static_cast<int>(MaterialType::DiffuseLight)]
+            << ", \"other\": " << hitsByMaterial[static_cast<int>(MaterialType::Other)] << "}"
+            << ", \"terminations\": {\"escaped\": " << escaped << ", \"absorbed\": " << absorbed
+            << ", \"depth_limit\": " << depthLimited << ", \"russian_roulette\": " << rouletteEnded << "}"
+            << ", \"bounce_histogram\": [";
+        int last = maxHistogramBounces;
+        while (last > 0 && bounceHistogram[last] == 0) {
+            last--;
+        }
+        for (int i = 0; i <= last; i++) {
+            out << (i > 0 ? ", " : "") << bounceHistogram[i];
+        }
+        out << "]}";
+    }
+
+private:
+    void countPathLength(int numRays, long long numPaths = 1) {
+        bounceHistogram[std::clamp(numRays, 0, maxHistogramBounces)] += numPaths;
+    }
+};
+
+/**
+ * Counters of the calling thread. Render workers fold them into their own totals after every tile.
+ */
+inline thread_local RenderStats localRenderStats;
+
+#endif//RAYTRACER_RENDER_STATS_H
@@ -2,71 +2,138 @@
 #define RAYTRACER_RENDERER_H
 
 #include "camera.h"
+#include "checkpoint.h"
+#include "closed_scene.h"
 #include "color.h"
-#include "gui.h"
-#include "hittable_list.h"
+#include "denoiser.h"
+#include "hittable.h"
 #include "image.h"
+#include "lights.h"
+#include "russian_roulette.h"
+#include "tile_scheduler.h"
+#include "wavefront.h"
+#include <algorithm>
 #include <atomic>
-#include <execution>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+enum class Integrator {
+    Recursive,// one path at a time, recursing through Material::scatter
+    Wavefront // batches of paths advanced bounce by bounce, see WavefrontIntegrator
+};
 
 class Renderer {
 public:
-    Renderer(int imageWidth, int imageHeight, int maxDepth) : imageWidth(imageWidth),
-                                                              imageHeight(imageHeight),
-                                                              maxDepth(maxDepth) {
+    /**
+     *
+     * @param numThreads number of render workers, or 0 to use one per hardware thread.
+     */
+    Renderer(int imageWidth, int imageHeight, int maxDepth, uint64_t seed = 0, int numThreads = 0, int tileSize = 32)
+        : imageWidth(imageWidth),
+          imageHeight(imageHeight),
+          maxDepth(maxDepth),
+          seed(seed),
+          scheduler(numThreads, tileSize) {
         cumulativeData.resize(imageWidth * imageHeight);
+        cumulativeLuminanceSquared.resize(imageWidth * imageHeight);
+        pixelSamples.resize(imageWidth * imageHeight);
+        isConverged.resize(imageWidth * imageHeight);
+        passSamples.resize(imageWidth * imageHeight);
+        pixelDepth.resize(imageWidth * imageHeight, std::numeric_limits<Real>::quiet_NaN());
+        workerScratch.resize(scheduler.getNumThreads());
     }
 
-    std::shared_ptr<Image> render(const Camera &camera, const HittableList &scene) {
-        isRendering = true;
+    /**
+     * Renders one pass. The samples of a pass are staged and only added to the accumulation once every tile is
+     * done, so a pass cancelled by interrupt() leaves no trace. Returns nullptr if the pass was cancelled, or if
+     * interrupt() was called after passEpoch was read from getEpoch(): a caller that reads the epoch together with
+     * the settings it applies never renders a pass that is already stale.
+     */
+    std::shared_ptr<Image> render(const Camera &camera, const Hittable &scene, unsigned long long passEpoch) {
+        // interrupt() bumps the epoch before raising the flag, so clearing the flag first cannot lose an interrupt.
+        isInterrupted = false;
+        if (epoch != passEpoch) {
+            return nullptr;
+        }
+        if (previewLevel < numPreviewLevels) {
+            return renderPreview(camera, scene, passEpoch);
+        }
         const int numPixels = imageWidth * imageHeight;
         int *data = new int[numPixels];
 
-        std::vector<int> indices(numPixels);
-        std::generate(indices.begin(), indices.end(), [n = 0]() mutable { return n++; });
+        // Spread a budget of one sample per pixel over the pixels that have not converged yet.
+        int samplesPerActivePixel = 1;
+        if (isAdaptive) {
+            auto numActive = std::count(isConverged.begin(), isConverged.end(), 0);
+            samplesPerActivePixel = static_cast<int>(std::clamp<long long>(numPixels / std::max<long long>(numActive, 1), 1, maxSamplesPerPass));
+        }
 
-        auto start = std::chrono::high_resolution_clock::now();
-        std::find_if(
-                std::execution::par,
-                indices.begin(),
-                indices.end(),
-                [this, &scene, &camera, &data, numPixels](auto &&i) {
-                    if (isInterrupted) {
-                        return true;
-                    }
+        clearScratch();
+        bool trackFeatures = isFeatureTracking();
+        if (trackFeatures && cumulativeFeatures.empty()) {
+            cumulativeFeatures.resize(numPixels, SampleFeatures{});
+            featureSamples.resize(numPixels);
+            passFeatures.resize(numPixels);
+        }
 
-                    int row = static_cast<double>((numPixels - 1) - i) / imageWidth;
-                    int col = i % imageWidth;
-                    auto v = (row + randomDouble()) / (imageHeight - 1);
-                    auto u = (col + randomDouble()) / (imageWidth - 1);
-                    Color color = pixelColor(scene, camera, u, v);
-                    cumulativeData[i] += color;
-                    data[i] = toInt(cumulativeData[i] / (samplesAccumulated + 1));
-                    return false;
-                });
+        auto start = std::chrono::high_resolution_clock::now();
+        bool isComplete = scheduler.run(
+                imageWidth,
+                imageHeight,
+                [this, &scene, &camera, samplesPerActivePixel, trackFeatures](const Tile &tile, int worker) {
+                    renderTile(tile, workerScratch[worker], scene, camera, samplesPerActivePixel, trackFeatures);
+                },
+                isInterrupted);
+        if (!isComplete || epoch != passEpoch) {
+            pendingCheckpoint.reset();
+            delete[] data;
+            return nullptr;
+        }
+        scheduler.run(
+                imageWidth,
+                imageHeight,
+                [this, data, trackFeatures](const Tile &tile, int) {
+                    commitTile(tile, data, trackFeatures);
+                },
+                neverCancelled);
         auto end = std::chrono::high_resolution_clock::now();
 
-        if (isInterrupted) {
-            isInterrupted = false;
-            isRendering = false;
-            return nullptr;
+        if (pendingCheckpoint) {
+            completedCheckpoint = std::move(pendingCheckpoint);
+            pendingCheckpoint.reset();// a moved-from optional still holds a value
         }
 
+        hasReprojectedHistory = false;
         samplesAccumulated++;
+        updateSampleCost(end - start);
         auto durationMillis = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
         cumulativeRenderTimeMillis += durationMillis;
         std::shared_ptr<Image> img = std::make_shared<Image>(imageWidth, imageHeight, samplesAccumulated, data, cumulativeRenderTimeMillis);
-        isRendering = false;
+        img->schedulerStats = scheduler.getLastStats();
+        img->generation = ++generation;
+        for (const auto &scratch: workerScratch) {
+            img->changedTiles.insert(img->changedTiles.end(), scratch.changedTiles.begin(), scratch.changedTiles.end());
+            RAYTRACER_STAT(renderStats.merge(scratch.stats));
+        }
+        img->renderStats = renderStats;
+        fillSampleStats(*img);
+        if (isDenoised) {
+            denoise(*img);
+        }
+        noteFeedback(*img);
         return img;
     }
 
-    void setImageWidth(int width) {
-        imageWidth = width;
-    }
-
-    void setImageHeight(int height) {
-        imageHeight = height;
+    std::shared_ptr<Image> render(const Camera &camera, const Hittable &scene) {
+        return render(camera, scene, epoch);
     }
 
     void setMaxDepth(int depth) {
@@ -85,56 +152,1043 @@ public:
         return maxDepth;
     }
 
+    void setSeed(uint64_t value) {
+        seed = value;
+    }
+
+    uint64_t getSeed() const {
+        return seed;
+    }
+
+    /**
+     * Index of the first sample drawn for every pixel. Renderers with the same seed and disjoint sample ranges
+     * produce independent samples whose accumulations can be added up.
+     */
+    void setSampleOffset(int value) {
+        sampleOffset = value;
+    }
+
+    int getSampleOffset() const {
+        return sampleOffset;
+    }
+
     int getSamplesAccumulated() const {
         return samplesAccumulated;
     }
 
+    void setTileSize(int size) {
+        scheduler.setTileSize(size);
+    }
+
+    int getTileSize() const {
+        return scheduler.getTileSize();
+    }
+
+    int getNumThreads() const {
+        return scheduler.getNumThreads();
+    }
+
+    /**
+     * With adaptive sampling on, pixels whose estimated noise is below the target noise level are skipped
+     * and their share of each pass is spent on the remaining pixels.
+     */
+    void setAdaptiveSampling(bool value) {
+        isAdaptive = value;
+    }
+
+    bool isAdaptiveSampling() const {
+        return isAdaptive;
+    }
+
+    /**
+     *
+     * @param value standard error of a pixel in display (gamma corrected, [0,1]) units at which it counts as converged.
+     */
+    void setTargetNoise(double value) {
+        targetNoise = value;
+    }
+
+    double getTargetNoise() const {
+        return targetNoise;
+    }
+
+    void setIntegrator(Integrator value) {
+        integrator = value;
+    }
+
+    Integrator getIntegrator() const {
+        return integrator;
+    }
+
+    /**
+     * With Russian roulette on, paths whose throughput has become small may end before the maximum depth, see
+     * russian_roulette::play(). The image stays unbiased but most paths end sooner, so the maximum depth can be
+     * raised for scenes with a lot of glass at little cost.
+     */
+    void setRussianRoulette(bool value) {
+        isRoulette = value;
+    }
+
+    bool isRussianRoulette() const {
+        return isRoulette;
+    }
+
+    /**
+     * Sets the lights of the scene passed to render(): whether it has a sky and which emitters are sampled directly.
+     * Not to be called while a pass is running.
+     */
+    void setLights(const Lights &value) {
+        lights = value;
+    }
+
+    const Lights &getLights() const {
+        return lights;
+    }
+
+    /**
+     * With progressive preview on, the passes after reset() first render one sample per block of 8x8, 4x4 and then
+     * 2x2 pixels, each shown upscaled, before full-resolution accumulation starts. Preview passes are not
+     * accumulated. The first preview level is the finest whose estimated time fits the latency target, or the time
+     * since the previous reset if that is shorter, so the first image after a change arrives within the target
+     * whatever the scene costs; levels are skipped entirely once a full pass fits.
+     */
+    void setProgressivePreview(bool value) {
+        isPreviewEnabled = value;
+    }
+
+    bool isProgressivePreview() const {
+        return isPreviewEnabled;
+    }
+
+    void setPreviewLatencyTarget(double millis) {
+        previewLatencyTargetMillis = millis;
+    }
+
+    double getPreviewLatencyTarget() const {
+        return previewLatencyTargetMillis;
+    }
+
+    /**
+     * With depth tracking on, the renderer stores for every pixel the distance to the surface seen through its
+     * centre, which reproject() needs. It costs one extra ray per pixel after each reset.
+     */
+    void setDepthTracking(bool value) {
+        isDepthTracked = value;
+    }
+
+    bool isDepthTracking() const {
+        return isDepthTracked;
+    }
+
+    /**
+     * With feature tracking on, the renderer accumulates for every pixel the albedo, normal and depth that its
+     * camera samples hit first, the guide images of the denoiser. Samples rendered while it is off have no features.
+     */
+    void setFeatureTracking(bool value) {
+        isFeatureTracked = value;
+    }
+
+    bool isFeatureTracking() const {
+        return isFeatureTracked || isDenoised;
+    }
+
+    /**
+     * With denoising on, every full-resolution image, including those of accumulatedImage(), is filtered by an
+     * edge-aware Denoiser guided by the tracked features, and the time it took is reported in Image::denoiseMillis.
+     * Turns feature tracking on; pixels without features are filtered on their colour alone. The accumulation
+     * itself is never filtered.
+     */
+    void setDenoising(bool value) {
+        isDenoised = value;
+    }
+
+    bool isDenoising() const {
+        return isDenoised;
+    }
+
+    /**
+     * Filter settings used while denoising. Must not be changed while a pass is rendering.
+     */
+    Denoiser &getDenoiser() {
+        return denoiser;
+    }
+
+    /**
+     * Moves the accumulation from the view of the previous camera to that of the current one instead of discarding
+     * it. Every pixel with a known depth is projected into the new view, the nearest one winning where several
+     * land on the same pixel, and keeps at most maxReprojectedSamples of its samples, so that shading which depends
+     * on the view direction is soon replaced by new samples. Pixels nothing lands on, where the new view sees
+     * surfaces the old one did not, start from scratch. Requires depth tracking and must not be called while a
+     * pass is rendering.
+     *
+     * @return the reprojected accumulation for immediate display, with the empty pixels filled in from their row.
+     */
+    std::shared_ptr<Image> reproject(const Camera &previous, const Camera &current) {
+        const int width = imageWidth;
+        const int height = imageHeight;
+        const int numPixels = width * height;
+        std::vector<int> source(numPixels, -1);
+        std::vector<Real> nearest(numPixels, std::numeric_limits<Real>::infinity());
+        for (int i = 0; i < numPixels; i++) {
+            Real depth = pixelDepth[i];
+            if (pixelSamples[i] == 0 || std::isnan(depth)) {
+                continue;
+            }
+            int x = i % width;
+            int row = height - 1 - i / width;
+            auto r = previous.getPinholeRay((x + Real(0.5)) / (width - 1), (row + Real(0.5)) / (height - 1));
+            // Pixels that saw the sky only move with the view direction.
+            bool isFinite = std::isfinite(depth);
+            auto projection = isFinite ? current.project(r.at(depth)) : current.projectDirection(r.direction());
+            if (!projection) {
+                continue;
+            }
+            Real newX = std::floor(projection->s * (width - 1));
+            Real newRow = std::floor(projection->t * (height - 1));
+            if (newX < 0 || newX >= width || newRow < 0 || newRow >= height) {
+                continue;
+            }
+            int j = (height - 1 - static_cast<int>(newRow)) * width + static_cast<int>(newX);
+            Real newDepth = isFinite ? projection->depth : std::numeric_limits<Real>::infinity();
+            if (source[j] < 0 || newDepth < nearest[j]) {
+                source[j] = i;
+                nearest[j] = newDepth;
+            }
+        }
+
+        std::vector<Color> data(numPixels, Color(0, 0, 0));
+        std::vector<double> luminanceSquared(numPixels, 0.0);
+        std::vector<int> samples(numPixels, 0);
+        std::vector<SampleFeatures> features(cumulativeFeatures.empty() ? 0 : numPixels, SampleFeatures{});
+        std::vector<int> featureCounts(features.size(), 0);
+        int numReused = 0;
+        for (int j = 0; j < numPixels; j++) {
+            int i = source[j];
+            if (i < 0) {
+                pixelDepth[j] = std::numeric_limits<Real>::quiet_NaN();
+                continue;
+            }
+            double weight = std::min(1.0, static_cast<double>(maxReprojectedSamples) / pixelSamples[i]);
+            data[j] = cumulativeData[i] * weight;
+            luminanceSquared[j] = cumulativeLuminanceSquared[i] * weight;
+            samples[j] = std::min(pixelSamples[i], maxReprojectedSamples);
+            if (!features.empty() && featureSamples[i] > 0) {
+                double featureWeight = std::min(1.0, static_cast<double>(maxReprojectedSamples) / featureSamples[i]);
+                features[j] = scaleFeatures(cumulativeFeatures[i], featureWeight);
+                featureCounts[j] = std::min(featureSamples[i], maxReprojectedSamples);
+            }
+            numReused++;
+        }
+        for (int j = 0; j < numPixels; j++) {
+            if (source[j] >= 0) {
+                pixelDepth[j] = nearest[j];
+            }
+        }
+        cumulativeData = std::move(data);
+        cumulativeLuminanceSquared = std::move(luminanceSquared);
+        pixelSamples = std::move(samples);
+        cumulativeFeatures = std::move(features);
+        featureSamples = std::move(featureCounts);
+        std::fill(isConverged.begin(), isConverged.end(), 0);
+        samplesAccumulated = 0;
+        cumulativeRenderTimeMillis = std::chrono::milliseconds(0);
+        renderStats = {};
+        reprojectedFraction = static_cast<double>(numReused) / numPixels;
+        hasReprojectedHistory = true;
+
+        auto img = accumulatedImage();
+        for (int y = 0; y < height; y++) {
+            // Fill each run of empty pixels from the nearest reprojected pixel on its left, or on its right at the
+            // start of a row.
+            int last = -1;
+            for (int x = 0; x < width; x++) {
+                int j = y * width + x;
+                if (source[j] >= 0) {
+                    if (last < 0) {
+                        std::fill(img->data + y * width, img->data + j, img->data[j]);
+                    }
+                    last = j;
+                } else if (last >= 0) {
+                    img->data[j] = img->data[last];
+                }
+            }
+        }
+        return img;
+    }
+
+    /**
+     * Changes the resolution, resampling the accumulation instead of discarding it: each new pixel takes the samples
+     * of the old pixels it overlaps, in proportion to the overlapping area. Downscaled pixels so gather the samples
+     * of several old ones, while upscaled pixels keep the mean of their old pixel with a share of its samples,
+     * which new samples soon outweigh. Depths are probed again, and adaptive sampling starts over. Must not be
+     * called while a pass is rendering.
+     *
+     * @return the resampled accumulation for immediate display, or nullptr if there was none or the size is unchanged.
+     */
+    std::shared_ptr<Image> resize(int width, int height) {
+        if (width == imageWidth && height == imageHeight) {
+            return nullptr;
+        }
+        const int oldWidth = imageWidth;
+        const int numPixels = width * height;
+        auto columns = overlaps(oldWidth, width);
+        auto rows = overlaps(imageHeight, height);
+        bool hasFeatures = !cumulativeFeatures.empty();
+        bool hasSamples = false;
+
+        std::vector<Color> data(numPixels, Color(0, 0, 0));
+        std::vector<double> luminanceSquared(numPixels, 0.0);
+        std::vector<int> samples(numPixels, 0);
+        std::vector<SampleFeatures> features(hasFeatures ? numPixels : 0, SampleFeatures{});
+        std::vector<int> featureCounts(features.size(), 0);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int j = y * width + x;
+                Color sum(0, 0, 0);
+                double squares = 0;
+                double count = 0;
+                SampleFeatures featureSum{};
+                double featureCount = 0;
+                for (auto [oldY, weightY]: rows[y]) {
+                    for (auto [oldX, weightX]: columns[x]) {
+                        int i = oldY * oldWidth + oldX;
+                        double weight = weightX * weightY;
+                        sum += cumulativeData[i] * weight;
+                        squares += cumulativeLuminanceSquared[i] * weight;
+                        count += pixelSamples[i] * weight;
+                        if (hasFeatures) {
+                            addFeatures(featureSum, scaleFeatures(cumulativeFeatures[i], weight));
+                            featureCount += featureSamples[i] * weight;
+                        }
+                    }
+                }
+                // Sample counts are whole, so the sums are scaled to the rounded count to keep their mean.
+                if (count > 0) {
+                    samples[j] = std::max(1, static_cast<int>(std::lround(count)));
+                    data[j] = sum * (samples[j] / count);
+                    luminanceSquared[j] = squares * (samples[j] / count);
+                    hasSamples = true;
+                }
+                if (featureCount > 0) {
+                    featureCounts[j] = std::max(1, static_cast<int>(std::lround(featureCount)));
+                    features[j] = scaleFeatures(featureSum, featureCounts[j] / featureCount);
+                }
+            }
+        }
+
+        imageWidth = width;
+        imageHeight = height;
+        cumulativeData = std::move(data);
+        cumulativeLuminanceSquared = std::move(luminanceSquared);
+        pixelSamples = std::move(samples);
+        cumulativeFeatures = std::move(features);
+        featureSamples = std::move(featureCounts);
+        isConverged.assign(numPixels, 0);
+        passSamples.resize(numPixels);
+        passFeatures.resize(hasFeatures ? numPixels : 0);
+        pixelDepth.assign(numPixels, std::numeric_limits<Real>::quiet_NaN());
+        pendingCheckpoint.reset();
+        return hasSamples ? accumulatedImage() : nullptr;
+    }
+
+    /**
+     * Fraction of the pixels that kept their samples in the last reproject().
+     */
+    double getReprojectedFraction() const {
+        return reprojectedFraction;
+    }
+
+    /**
+     * Time from the last reset() to the first image rendered after it, or 0 before the first reset.
+     */
+    double getFeedbackLatencyMillis() const {
+        return feedbackLatencyMillis;
+    }
+
     void reset() {
+        hasReprojectedHistory = false;
         cumulativeRenderTimeMillis = std::chrono::milliseconds(0);
         samplesAccumulated = 0;
         std::fill(cumulativeData.begin(), cumulativeData.end(), Color(0, 0, 0));
+        std::fill(cumulativeLuminanceSquared.begin(), cumulativeLuminanceSquared.end(), 0.0);
+        std::fill(pixelSamples.begin(), pixelSamples.end(), 0);
+        std::fill(isConverged.begin(), isConverged.end(), 0);
+        clearFeatures();
+        renderStats = {};
+        std::lock_guard<std::mutex> lock(m);
+        auto now = std::chrono::steady_clock::now();
+        // While changes arrive faster than the latency target, e.g. during a slider drag, the first preview has to
+        // finish before the next change cancels it.
+        double budget = std::min<double>(previewLatencyTargetMillis, std::chrono::duration<double, std::milli>(now - resetTime).count());
+        previewLevel = isPreviewEnabled ? firstPreviewLevel(budget) : numPreviewLevels;
+        resetTime = now;
+        isAwaitingFeedback = true;
     }
 
-    void interrupt() {
-        if (!isRendering) {
-            return;
+    /**
+     * Builds an image of the current accumulation, e.g. after restoreCheckpoint(), denoised if denoising is on.
+     * It counts as a new generation in which every pixel changed. Must not be called while a pass is rendering.
+     */
+    [[nodiscard]] std::shared_ptr<Image> accumulatedImage() {
+        const int numPixels = imageWidth * imageHeight;
+        int *data = new int[numPixels];
+        for (int i = 0; i < numPixels; i++) {
+            data[i] = toInt(cumulativeData[i] / std::max(pixelSamples[i], 1));
         }
+        auto img = std::make_shared<Image>(imageWidth, imageHeight, samplesAccumulated, data, cumulativeRenderTimeMillis);
+        img->generation = ++generation;
+        img->changedTiles.push_back({0, 0, imageWidth, imageHeight});
+        img->renderStats = renderStats;
+        fillSampleStats(*img);
+        if (isDenoised) {
+            denoise(*img);
+        }
+        return img;
+    }
+
+    /**
+     * Arranges for the next pass to capture the accumulation state as it was before that pass. Each worker copies
+     * a tile just before adding its first samples to it, so the copy is spread over the pass instead of stalling
+     * the workers. Pass a checkpoint returned earlier to reuse its buffers. Must not be called while a pass is
+     * rendering.
+     */
+    void requestCheckpoint(RenderCheckpoint buffer = {}) {
+        const size_t numPixels = cumulativeData.size();
+        buffer.width = imageWidth;
+        buffer.height = imageHeight;
+        buffer.seed = seed;
+        buffer.samplesAccumulated = samplesAccumulated;
+        buffer.renderTime = cumulativeRenderTimeMillis;
+        buffer.generation = generation;
+        buffer.stats = renderStats;
+        buffer.cumulativeData.resize(numPixels);
+        buffer.cumulativeLuminanceSquared.resize(numPixels);
+        buffer.pixelSamples.resize(numPixels);
+        buffer.isConverged.resize(numPixels);
+        pendingCheckpoint = std::move(buffer);
+    }
+
+    /**
+     * Returns the checkpoint requested before the last pass once that pass has completed. A checkpoint whose pass
+     * was cancelled is dropped and has to be requested again.
+     */
+    std::optional<RenderCheckpoint> takeCheckpoint() {
+        auto checkpoint = std::move(completedCheckpoint);
+        completedCheckpoint.reset();
+        return checkpoint;
+    }
+
+    /**
+     * Copies the accumulation state at once. Must not be called while a pass is rendering.
+     */
+    [[nodiscard]] RenderCheckpoint saveCheckpoint() const {
+        RenderCheckpoint checkpoint;
+        checkpoint.width = imageWidth;
+        checkpoint.height = imageHeight;
+        checkpoint.seed = seed;
+        checkpoint.samplesAccumulated = samplesAccumulated;
+        checkpoint.renderTime = cumulativeRenderTimeMillis;
+        checkpoint.generation = generation;
+        checkpoint.stats = renderStats;
+        checkpoint.cumulativeData = cumulativeData;
+        checkpoint.cumulativeLuminanceSquared = cumulativeLuminanceSquared;
+        checkpoint.pixelSamples = pixelSamples;
+        checkpoint.isConverged = isConverged;
+        return checkpoint;
+    }
+
+    /**
+     * Continues from a saved accumulation state, including its seed. Checkpoints hold no features, so the
+     * restored samples have none. Throws std::invalid_argument if the checkpoint has another resolution.
+     */
+    void restoreCheckpoint(const RenderCheckpoint &checkpoint) {
+        if (checkpoint.width != imageWidth || checkpoint.height != imageHeight) {
+            throw std::invalid_argument("Checkpoint is " + std::to_string(checkpoint.width) + "x" + std::to_string(checkpoint.height)
+                                        + ", the renderer " + std::to_string(imageWidth) + "x" + std::to_string(imageHeight));
+        }
+        seed = checkpoint.seed;
+        samplesAccumulated = checkpoint.samplesAccumulated;
+        cumulativeRenderTimeMillis = checkpoint.renderTime;
+        generation = checkpoint.generation;
+        renderStats = checkpoint.stats;
+        cumulativeData = checkpoint.cumulativeData;
+        cumulativeLuminanceSquared = checkpoint.cumulativeLuminanceSquared;
+        pixelSamples = checkpoint.pixelSamples;
+        isConverged = checkpoint.isConverged;
+        clearFeatures();
+    }
+
+    /**
+     * Cancels the pass being rendered, if any, at the next tile boundary, and every pass started with an earlier
+     * epoch. May be called from any thread.
+     */
+    void interrupt() {
+        epoch++;
         isInterrupted = true;
     }
 
+    unsigned long long getEpoch() const {
+        return epoch;
+    }
+
 private:
+    static constexpr int minAdaptiveSamples = 8;
+    static constexpr int maxSamplesPerPass = 8;
+    static constexpr int maxReprojectedSamples = 32;
+    static constexpr int disoccludedSamples = 4;// in the first pass after reproject()
+    static constexpr int previewScales[] = {8, 4, 2};
+    static constexpr int numPreviewLevels = 3;// level numPreviewLevels is full resolution
+
+    struct PixelSamples {
+        Color sum;
+        double luminanceSquared;
+        int count;
+    };
+
     std::vector<Color> cumulativeData;
+    std::vector<double> cumulativeLuminanceSquared;
+    std::vector<int> pixelSamples;
+    std::vector<uint8_t> isConverged;// not vector<bool>: workers write neighbouring pixels concurrently
+    std::vector<PixelSamples> passSamples;// samples of the current pass, committed once it completes
+    std::vector<SampleFeatures> cumulativeFeatures;// empty until features are first tracked
+    std::vector<int> featureSamples;              // samples that contributed to cumulativeFeatures
+    std::vector<SampleFeatures> passFeatures;
+    std::atomic_bool isFeatureTracked = false;
+    std::atomic_bool isDenoised = false;
+    Denoiser denoiser;
+    std::vector<Real> pixelDepth;// ray parameter of the first hit through the pixel centre, NaN if unknown
+    std::atomic_bool isDepthTracked = false;
+    double reprojectedFraction = 0;
+    bool hasReprojectedHistory = false;// until the first pass after reproject() completes
+    std::atomic_bool isAdaptive = false;
+    std::atomic<double> targetNoise = 0.01;
+    std::atomic<Integrator> integrator = Integrator::Recursive;
+    std::atomic_bool isRoulette = false;
+    Lights lights;
     std::chrono::milliseconds cumulativeRenderTimeMillis = std::chrono::milliseconds(0);
     std::atomic_int samplesAccumulated = 0;
-    std::atomic_bool isRendering = false;
+    std::atomic<unsigned long long> epoch = 0;
     std::atomic_bool isInterrupted = false;
+    const std::atomic_bool neverCancelled = false;
 
     std::atomic_int imageWidth;
     std::atomic_int imageHeight;
     std::atomic_int maxDepth;
+    std::atomic_uint64_t seed;
+    std::atomic_int sampleOffset = 0;
+    unsigned long long generation = 0;
+    RenderStats renderStats;
+    std::optional<RenderCheckpoint> pendingCheckpoint;  // filled tile by tile during the current pass
+    std::optional<RenderCheckpoint> completedCheckpoint;
+    std::atomic_bool isPreviewEnabled = false;
+    std::atomic<double> previewLatencyTargetMillis = 50;
+    std::atomic_int previewLevel = numPreviewLevels;
+    double millisPerSample = 0;// wall time per camera sample of the last complete pass, 0 until known
+    std::atomic<double> feedbackLatencyMillis = 0;
+    std::chrono::steady_clock::time_point resetTime;// guarded by m, like isAwaitingFeedback
+    bool isAwaitingFeedback = false;
     mutable std::mutex m;
 
+    TileScheduler scheduler;
+
+    /**
+     * Per-worker buffers reused across tiles.
+     */
+    struct WorkerScratch {
+        std::vector<Ray> rays;
+        std::vector<Rng> rngs;
+        std::vector<int> samplePixels;// image pixel each camera sample belongs to
+        std::vector<Color> radiance;
+        std::vector<SampleFeatures> features;// first hits of the camera samples, if tracked
+        std::vector<Tile> changedTiles;// tiles that received samples in the current pass
+        long long numSamples = 0;      // camera samples traced in the current pass
+        RenderStats stats;             // counters of the current pass
+        WavefrontIntegrator wavefront;
+    };
+
+    std::vector<WorkerScratch> workerScratch;
+
+    /**
+     * For each of newSize pixels along an axis, the oldSize pixels that cover it and by how much, in old pixels.
+     */
+    static std::vector<std::vector<std::pair<int, double>>> overlaps(int oldSize, int newSize) {
+        std::vector<std::vector<std::pair<int, double>>> result(newSize);
+        double scale = static_cast<double>(oldSize) / newSize;
+        for (int j = 0; j < newSize; j++) {
+            double begin = j * scale;
+            double end = (j + 1) * scale;
+            for (int i = static_cast<int>(begin); i < oldSize && i < end; i++) {
+                double overlap = std::min<double>(end, i + 1) - std::max<double>(begin, i);
+                if (overlap > 0) {
+                    result[j].emplace_back(i, overlap);
+                }
+            }
+        }
+        return result;
+    }
+
+    static double luminance(const Color &color) {
+        return 0.2126 * color.x() + 0.7152 * color.y() + 0.0722 * color.z();
+    }
+
+    /**
+     * Standard error of the pixel's mean luminance, scaled by the slope of the gamma curve at the mean
+     * so that it approximates the noise visible on screen.
+     */
+    double pixelNoise(int i) const {
+        int n = pixelSamples[i];
+        if (n < 2) {
+            return std::numeric_limits<double>::infinity();
+        }
+        double mean = luminance(cumulativeData[i]) / n;
+        double variance = std::max(0.0, (cumulativeLuminanceSquared[i] / n - mean * mean) * n / (n - 1));
+        return sqrt(variance / n) / (2 * sqrt(std::max(mean, 1e-4)));
+    }
+
+    /**
+     * Variance of the pixel's mean luminance. With fewer than two samples the spread is unknown and the mean
+     * itself stands in for the standard error.
+     */
+    double meanVariance(int i) const {
+        int n = pixelSamples[i];
+        if (n == 0) {
+            return 0;
+        }
+        double mean = luminance(cumulativeData[i]) / n;
+        if (n < 2) {
+            return mean * mean;
+        }
+        return std::max(0.0, (cumulativeLuminanceSquared[i] / n - mean * mean) / (n - 1));
+    }
+
+    /**
+     * Traces the tile's samples and stages them in passSamples. Converged pixels are skipped when adaptive sampling
+     * is on, and every other pixel gets samplesPerActivePixel samples.
+     */
+    void renderTile(const Tile &tile, WorkerScratch &scratch, const Hittable &scene, const Camera &camera,
+                    int samplesPerActivePixel, bool trackFeatures) {
+        bool skipConverged = isAdaptive;
+        int depth = maxDepth;
+        for (int y = tile.y0; y < tile.y1; y++) {
+            std::fill(passSamples.begin() + y * imageWidth + tile.x0, passSamples.begin() + y * imageWidth + tile.x1,
+                      PixelSamples{Color(0, 0, 0), 0, 0});
+            if (trackFeatures) {
+                std::fill(passFeatures.begin() + y * imageWidth + tile.x0, passFeatures.begin() + y * imageWidth + tile.x1,
+                          SampleFeatures{});
+            }
+        }
+        scratch.rays.clear();
+        scratch.rngs.clear();
+        scratch.samplePixels.clear();
+
+        // Generate the camera samples of the whole tile.
+        for (int y = tile.y0; y < tile.y1; y++) {
+            // Storage row 0 is the top of the image, while v grows upwards.
+            int row = imageHeight - 1 - y;
+            for (int x = tile.x0; x < tile.x1; x++) {
+                int i = y * imageWidth + x;
+                if (skipConverged && isConverged[i]) {
+                    continue;
+                }
+                // Written at once rather than staged: the depth of a pixel without samples is never used.
+                if (isDepthTracked && (pixelSamples[i] == 0 || std::isnan(pixelDepth[i]))) {
+                    auto probe = camera.getPinholeRay((x + Real(0.5)) / (imageWidth - 1), (row + Real(0.5)) / (imageHeight - 1));
+                    auto hit = scene.intersect(probe, 0.001, std::numeric_limits<Real>::infinity());
+                    pixelDepth[i] = hit ? hit->t : std::numeric_limits<Real>::infinity();
+                }
+
+                // Disoccluded pixels catch up with their reprojected neighbours.
+                int numSamples = hasReprojectedHistory && pixelSamples[i] == 0 ? std::max(samplesPerActivePixel, disoccludedSamples)
+                                                                               : samplesPerActivePixel;
+                for (int s = 0; s < numSamples; s++) {
+                    Rng rng(seed, i, sampleOffset + pixelSamples[i] + s);
+                    auto v = (row + randomDouble(rng)) / (imageHeight - 1);
+                    auto u = (x + randomDouble(rng)) / (imageWidth - 1);
+                    scratch.rays.push_back(camera.getRay(u, v, rng));
+                    scratch.rngs.push_back(rng);
+                    scratch.samplePixels.push_back(i);
+                }
+            }
+        }
+
+        if (!scratch.rays.empty()) {
+            scratch.changedTiles.push_back(tile);
+        }
+        traceSamples(scratch, scene, depth, trackFeatures);
+
+        for (size_t k = 0; k < scratch.radiance.size(); k++) {
+            const auto &color = scratch.radiance[k];
+            auto &samples = passSamples[scratch.samplePixels[k]];
+            samples.sum += color;
+            samples.luminanceSquared += luminance(color) * luminance(color);
+            samples.count++;
+        }
+        if (trackFeatures) {
+            for (size_t k = 0; k < scratch.features.size(); k++) {
+                addFeatures(passFeatures[scratch.samplePixels[k]], scratch.features[k]);
+            }
+        }
+    }
+
+    /**
+     * Adds the tile's staged samples to the accumulation and writes its display pixels.
+     */
+    void commitTile(const Tile &tile, int *data, bool trackFeatures) {
+        if (pendingCheckpoint) {
+            copyTile(tile, *pendingCheckpoint);
+        }
+
+        for (int y = tile.y0; y < tile.y1; y++) {
+            for (int x = tile.x0; x < tile.x1; x++) {
+                int i = y * imageWidth + x;
+                const auto &samples = passSamples[i];
+                cumulativeData[i] += samples.sum;
+                cumulativeLuminanceSquared[i] += samples.luminanceSquared;
+                pixelSamples[i] += samples.count;
+                isConverged[i] = pixelSamples[i] >= minAdaptiveSamples && pixelNoise(i) <= targetNoise;
+                data[i] = toInt(cumulativeData[i] / std::max(pixelSamples[i], 1));
+                if (trackFeatures) {
+                    addFeatures(cumulativeFeatures[i], passFeatures[i]);
+                    featureSamples[i] += samples.count;
+                }
+            }
+        }
+    }
+
+    /**
+     * Traces the rays in the worker's scratch buffers into its radiance buffer, and their first hits into its
+     * features buffer if trackFeatures is set.
+     */
+    void traceSamples(WorkerScratch &scratch, const Hittable &scene, int depth, bool trackFeatures = false) {
+        // A closed scene is traced through its concrete types, without virtual calls per bounce.
+        if (const auto *closedScene = dynamic_cast<const ClosedScene *>(&scene)) {
+            traceSamplesIn(scratch, *closedScene, depth, trackFeatures);
+        } else {
+            traceSamplesIn(scratch, scene, depth, trackFeatures);
+        }
+    }
+
+    template<typename Scene>
+    void traceSamplesIn(WorkerScratch &scratch, const Scene &scene, int depth, bool trackFeatures) {
+        auto *features = trackFeatures ? &scratch.features : nullptr;
+        if (integrator == Integrator::Wavefront) {
+            scratch.wavefront.setRussianRoulette(isRoulette);
+            scratch.wavefront.trace(scene, lights, depth, scratch.rays, scratch.rngs, scratch.radiance, features);
+        } else {
+            scratch.radiance.resize(scratch.rays.size());
+            scratch.features.resize(trackFeatures ? scratch.rays.size() : 0);
+            for (size_t k = 0; k < scratch.rays.size(); k++) {
+                scratch.radiance[k] = rayColor(scratch.rays[k], scene, depth, depth, scratch.rngs[k], Color(1, 1, 1), 1,
+                                               trackFeatures ? &scratch.features[k] : nullptr);
+            }
+        }
+        scratch.numSamples += static_cast<long long>(scratch.rays.size());
+
+        // The worker's thread-local counters now hold this tile's work.
+        RAYTRACER_STAT(scratch.stats.merge(localRenderStats));
+        RAYTRACER_STAT(localRenderStats = {});
+    }
+
+    static void addFeatures(SampleFeatures &sum, const SampleFeatures &features) {
+        sum.albedo += features.albedo;
+        sum.normal += features.normal;
+        sum.depth += features.depth;
+    }
+
+    static SampleFeatures scaleFeatures(const SampleFeatures &features, double factor) {
+        return {features.albedo * factor, features.normal * factor, static_cast<Real>(features.depth * factor)};
+    }
+
+    void clearFeatures() {
+        std::fill(cumulativeFeatures.begin(), cumulativeFeatures.end(), SampleFeatures{});
+        std::fill(featureSamples.begin(), featureSamples.end(), 0);
+    }
+
+    /**
+     * Replaces the pixels of img, an image of the whole accumulation, by the denoised accumulation.
+     */
+    void denoise(Image &img) {
+        auto start = std::chrono::steady_clock::now();
+        const int width = imageWidth;
+        denoiser.resize(width, imageHeight);
+        scheduler.run(
+                width,
+                imageHeight,
+                [this, width](const Tile &tile, int) {
+                    for (int y = tile.y0; y < tile.y1; y++) {
+                        for (int x = tile.x0; x < tile.x1; x++) {
+                            int i = y * width + x;
+                            int n = featureSamples.empty() ? 0 : featureSamples[i];
+                            auto features = n > 0 ? scaleFeatures(cumulativeFeatures[i], 1.0 / n) : SampleFeatures{};
+                            denoiser.setPixel(i, cumulativeData[i] / std::max(pixelSamples[i], 1), meanVariance(i), features);
+                        }
+                    }
+                },
+                neverCancelled);
+        denoiser.filter(scheduler);
+        scheduler.run(
+                width,
+                imageHeight,
+                [this, &img, width](const Tile &tile, int) {
+                    for (int y = tile.y0; y < tile.y1; y++) {
+                        for (int x = tile.x0; x < tile.x1; x++) {
+                            img.data[y * width + x] = toInt(denoiser.getPixel(y * width + x));
+                        }
+                    }
+                },
+                neverCancelled);
+        img.changedTiles = {Tile{0, 0, width, imageHeight}};
+        img.denoiseMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void clearScratch() {
+        for (auto &scratch: workerScratch) {
+            scratch.changedTiles.clear();
+            scratch.numSamples = 0;
+            RAYTRACER_STAT(scratch.stats = {});
+        }
+    }
+
+    /**
+     * Renders the current preview level: one sample per block of previewScales[previewLevel] pixels, written to
+     * the whole block. The accumulation is left untouched.
+     */
+    std::shared_ptr<Image> renderPreview(const Camera &camera, const Hittable &scene, unsigned long long passEpoch) {
+        const int scale = previewScales[previewLevel];
+        int *data = new int[imageWidth * imageHeight];
+        clearScratch();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        bool isComplete = scheduler.run(
+                (imageWidth + scale - 1) / scale,
+                (imageHeight + scale - 1) / scale,
+                [this, &scene, &camera, data, scale](const Tile &tile, int worker) {
+                    renderPreviewTile(tile, scale, workerScratch[worker], scene, camera, data);
+                },
+                isInterrupted);
+        auto end = std::chrono::high_resolution_clock::now();
+        if (!isComplete || epoch != passEpoch) {
+            delete[] data;
+            return nullptr;
+        }
+
+        updateSampleCost(end - start);
+        previewLevel++;
+        // Skip the remaining levels once a full pass fits the latency target.
+        if (previewLevel < numPreviewLevels && estimatedMillis(1) <= previewLatencyTargetMillis) {
+            previewLevel = numPreviewLevels;
+        }
+
+        auto img = std::make_shared<Image>(imageWidth, imageHeight, samplesAccumulated, data, cumulativeRenderTimeMillis);
+        img->previewScale = scale;
+        img->schedulerStats = scheduler.getLastStats();
+        img->generation = ++generation;
+        for (const auto &scratch: workerScratch) {
+            img->changedTiles.insert(img->changedTiles.end(), scratch.changedTiles.begin(), scratch.changedTiles.end());
+        }
+        img->renderStats = renderStats;
+        fillSampleStats(*img);
+        noteFeedback(*img);
+        return img;
+    }
+
+    /**
+     * Renders a tile of the preview grid, where each pixel stands for a block of scale x scale image pixels.
+     */
+    void renderPreviewTile(const Tile &tile, int scale, WorkerScratch &scratch, const Hittable &scene,
+                           const Camera &camera, int *data) {
+        scratch.rays.clear();
+        scratch.rngs.clear();
+        for (int y = tile.y0; y < tile.y1; y++) {
+            for (int x = tile.x0; x < tile.x1; x++) {
+                // Through the centre of the block, which is clipped at the right and bottom edges.
+                Real centerX = (x * scale + std::min((x + 1) * scale, static_cast<int>(imageWidth)) - 1) / Real(2);
+                Real centerY = (y * scale + std::min((y + 1) * scale, static_cast<int>(imageHeight)) - 1) / Real(2);
+                Rng rng(seed, y * scale * imageWidth + x * scale, 0);
+                auto v = (imageHeight - 1 - centerY) / (imageHeight - 1);
+                auto u = centerX / (imageWidth - 1);
+                scratch.rays.push_back(camera.getRay(u, v, rng));
+                scratch.rngs.push_back(rng);
+            }
+        }
+        traceSamples(scratch, scene, maxDepth);
+
+        Tile blocks{tile.x0 * scale, tile.y0 * scale, std::min(tile.x1 * scale, static_cast<int>(imageWidth)),
+                    std::min(tile.y1 * scale, static_cast<int>(imageHeight))};
+        for (int y = blocks.y0; y < blocks.y1; y++) {
+            for (int x = blocks.x0; x < blocks.x1; x++) {
+                int k = (y / scale - tile.y0) * tile.width() + (x / scale - tile.x0);
+                data[y * imageWidth + x] = toInt(scratch.radiance[k]);
+            }
+        }
+        scratch.changedTiles.push_back(blocks);
+    }
+
+    /**
+     * Estimated wall time of a pass with one sample per block of scale x scale pixels.
+     */
+    [[nodiscard]] double estimatedMillis(int scale) const {
+        double blocks = std::ceil(static_cast<double>(imageWidth) / scale) * std::ceil(static_cast<double>(imageHeight) / scale);
+        return blocks * millisPerSample;
+    }
+
+    /**
+     * The finest preview level expected to finish within budgetMillis; the coarsest while the cost of a sample is
+     * unknown or if none fits.
+     */
+    [[nodiscard]] int firstPreviewLevel(double budgetMillis) const {
+        if (millisPerSample <= 0) {
+            return 0;
+        }
+        for (int level = numPreviewLevels; level > 0; level--) {
+            int scale = level == numPreviewLevels ? 1 : previewScales[level];
+            if (estimatedMillis(scale) <= budgetMillis) {
+                return level;
+            }
+        }
+        return 0;
+    }
+
+    void updateSampleCost(std::chrono::high_resolution_clock::duration elapsed) {
+        long long numSamples = 0;
+        for (const auto &scratch: workerScratch) {
+            numSamples += scratch.numSamples;
+        }
+        if (numSamples > 0) {
+            millisPerSample = std::chrono::duration<double, std::milli>(elapsed).count() / numSamples;
+        }
+    }
+
+    /**
+     * Records the feedback latency if img is the first image since the last reset, and attaches it to img.
+     */
+    void noteFeedback(Image &img) {
+        std::lock_guard<std::mutex> lock(m);
+        if (isAwaitingFeedback) {
+            feedbackLatencyMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - resetTime).count();
+            isAwaitingFeedback = false;
+        }
+        img.feedbackLatencyMillis = feedbackLatencyMillis;
+    }
+
+    void copyTile(const Tile &tile, RenderCheckpoint &checkpoint) const {
+        for (int y = tile.y0; y < tile.y1; y++) {
+            int begin = y * imageWidth + tile.x0;
+            int end = y * imageWidth + tile.x1;
+            std::copy(cumulativeData.begin() + begin, cumulativeData.begin() + end, checkpoint.cumulativeData.begin() + begin);
+            std::copy(cumulativeLuminanceSquared.begin() + begin, cumulativeLuminanceSquared.begin() + end,
+                      checkpoint.cumulativeLuminanceSquared.begin() + begin);
+            std::copy(pixelSamples.begin() + begin, pixelSamples.begin() + end, checkpoint.pixelSamples.begin() + begin);
+            std::copy(isConverged.begin() + begin, isConverged.begin() + end, checkpoint.isConverged.begin() + begin);
+        }
+    }
+
+    /**
+     * Fills in the converged fraction, the average sample count and a heat map of the per-pixel sample counts.
+     */
+    void fillSampleStats(Image &img) const {
+        const int numPixels = static_cast<int>(pixelSamples.size());
+        auto numConverged = std::count(isConverged.begin(), isConverged.end(), 1);
+        long long totalSamples = 0;
+        int maxSamples = 1;
+        for (int n: pixelSamples) {
+            totalSamples += n;
+            maxSamples = std::max(maxSamples, n);
+        }
+
+        img.convergedFraction = static_cast<double>(numConverged) / numPixels;
+        img.averageSamplesPerPixel = static_cast<double>(totalSamples) / numPixels;
+        img.sampleMap.resize(numPixels);
+        for (int i = 0; i < numPixels; i++) {
+            // Blue for the fewest samples through red for the most.
+            auto t = static_cast<double>(pixelSamples[i]) / maxSamples;
+            auto heat = Color(t, 1 - std::abs(2 * t - 1), 1 - t);
+            img.sampleMap[i] = toInt(heat * heat);
+        }
+    }
+
+
+    /**
+     *
+     * @param throughput of the path up to r, which Russian roulette is played with.
+     * @param emissionWeight of the light r finds, see Lights::emissionWeight().
+     * @param features if not null, receives what r hits first.
+     * @tparam Scene Hittable, or ClosedScene whose materials are then called through their concrete classes.
+     */
+    template<typename Scene>
+    Color rayColor(const Ray &r, const Scene &scene, int depth, int pathDepth, Rng &rng, const Color &throughput,
+                   Real emissionWeight, SampleFeatures *features = nullptr) {
+        // Bounce 0 is the camera sample, so the first scatter event draws from bounce 1.
+        int bounce = pathDepth - depth + 1;
 
-    Color rayColor(const Ray &r, const Hittable &scene, int depth) {
         // If we've exceeded the ray bounce limit, no more light is gathered.
         if (depth <= 0) {
+            RAYTRACER_STAT(localRenderStats.countDepthLimited(bounce - 1));
             return {0, 0, 0};
         }
 
-        if (auto rec = scene.hit(r, 0.001, std::numeric_limits<double>::infinity())) {
-            if (auto scattered = rec->material->scatter(r, *rec)) {
-                return rec->material->getAlbedo() * rayColor(*scattered, scene, depth - 1);
+        RAYTRACER_STAT(localRenderStats.countRay(bounce));
+        auto rec = scene.hit(r, 0.001, std::numeric_limits<Real>::infinity());
+        if (features) {
+            *features = rec ? SampleFeatures{rec->material->getAlbedo(), rec->normal, rec->t}
+                            : SampleFeatures{lights.sky(r.direction()), Vec3(0, 0, 0), 0};
+        }
+        if (rec) {
+            RAYTRACER_STAT(localRenderStats.countHit(*rec->material));
+            auto emitted = emissionWeight * rec->material->emitted(*rec);
+            rng.setBounce(bounce);
+            auto shadeHit = [&](const auto &material) {
+                return scatterHit(material, r, *rec, scene, depth, pathDepth, rng, throughput, emitted);
+            };
+            if constexpr (std::is_same_v<Scene, ClosedScene>) {
+                return visitMaterial(*rec->material, shadeHit);
+            } else {
+                return shadeHit(*rec->material);
             }
-            return {0, 0, 0};
         }
-        Vec3 unitDirection = unitVector(r.direction());
-        auto t = 0.5 * (unitDirection.y() + 1.0);
-        return (1.0 - t) * Color(1.0, 1.0, 1.0) + t * Color(0.5, 0.7, 1.0);
+        RAYTRACER_STAT(localRenderStats.countEscaped(bounce));
+        return lights.sky(r.direction());
     }
 
-    Color pixelColor(const HittableList &scene, const Camera &camera, double u, double v) {
-        Ray r = camera.getRay(u, v);
-        return rayColor(r, scene, maxDepth);
+    /**
+     * Light leaving the hit rec of r: what the surface emits, and what the material reflects from its scattered ray
+     * and its shadow ray.
+     */
+    template<typename M, typename Scene>
+    Color scatterHit(const M &material, const Ray &r, const HitRecord &rec, const Scene &scene, int depth, int pathDepth,
+                     Rng &rng, const Color &throughput, const Color &emitted) {
+        int bounce = pathDepth - depth + 1;
+        auto scattered = material.scatter(r, rec, rng);
+        if (!scattered) {
+            RAYTRACER_STAT(localRenderStats.countAbsorbed(bounce));
+            return emitted;
+        }
+        const auto &albedo = material.getAlbedo();
+        auto direct = traceShadowRay(lights.sampleShadowRay(r, rec, rng, material), scene);
+        auto nextWeight = lights.emissionWeight(r, rec, *scattered, material);
+        if (!isRoulette) {
+            return emitted + direct + albedo * rayColor(*scattered, scene, depth - 1, pathDepth, rng, throughput, nextWeight);
+        }
+        double survival = russian_roulette::play(throughput * albedo, bounce, rng);
+        if (survival == 0) {
+            RAYTRACER_STAT(localRenderStats.countRouletteEnded(bounce));
+            return emitted + direct;
+        }
+        auto weight = albedo / survival;
+        return emitted + direct + weight * rayColor(*scattered, scene, depth - 1, pathDepth, rng, throughput * weight, nextWeight);
+    }
+
+    /**
+     * Light found by a shadow ray, already weighted.
+     */
+    template<typename Scene>
+    [[nodiscard]] static Color traceShadowRay(const std::optional<Lights::ShadowRay> &shadowRay, const Scene &scene) {
+        if (!shadowRay) {
+            return {0, 0, 0};
+        }
+        RAYTRACER_STAT(localRenderStats.countShadowRay());
+        auto rec = scene.hit(shadowRay->ray, 0.001, std::numeric_limits<Real>::infinity());
+        return rec ? shadowRay->weight * rec->material->emitted(*rec) : Color(0, 0, 0);
     }
 };
 
@@ -0,0 +1,66 @@
+#ifndef RAYTRACER_RNG_H
+#define RAYTRACER_RNG_H
+
+#include <cstdint>
+
+/**
+ * PCG32 generator (https://www.pcg-random.org) keyed by (seed, pixel, sample index).
+ *
+ * Every camera sample owns its own generator, so no state is shared between render threads and the image
+ * only depends on the seed. setBounce() re-keys the generator to the stream of a path vertex, which makes the
+ * numbers drawn at each bounce a pure function of (seed, pixel, sample index, bounce), independent of how many
+ * numbers earlier bounces consumed.
+ */
+class Rng {
+public:
+    explicit Rng(uint64_t seed = 0) : key(mix(seed)) {
+        setBounce(0);
+    }
+
+    Rng(uint64_t seed, uint32_t pixel, uint32_t sample) : key(mix(mix(seed) ^ (static_cast<uint64_t>(pixel) << 32 | sample))) {
+        setBounce(0);
+    }
+
+    void setBounce(uint32_t bounce) {
+        state = 0;
+        increment = (key << 1u) | 1u;
+        nextUInt();
+        state += mix(key + bounce);
+        nextUInt();
+    }
+
+    uint32_t nextUInt() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + increment;
+        auto xorShifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+        auto rot = static_cast<uint32_t>(old >> 59u);
+        return (xorShifted >> rot) | (xorShifted << ((-rot) & 31u));
+    }
+
+    /**
+     *
+     * @return A random real in [0,1).
+     */
+    double nextDouble() {
+        // 53 random bits from two outputs fill the whole double mantissa.
+        uint64_t bits = (static_cast<uint64_t>(nextUInt()) << 21u) ^ nextUInt();
+        return static_cast<double>(bits & ((1ULL << 53u) - 1)) * 0x1.0p-53;
+    }
+
+private:
+    uint64_t key;
+    uint64_t state = 0;
+    uint64_t increment = 1;
+
+    /**
+     * SplitMix64 finalizer, used to spread structured keys over the whole state space.
+     */
+    static uint64_t mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30u)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27u)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31u);
+    }
+};
+
+#endif//RAYTRACER_RNG_H
@@ -0,0 +1,321 @@
+#ifndef RAYTRACER_SCENE_CACHE_H
+#define RAYTRACER_SCENE_CACHE_H
+
+#include "bvh.h"
+#include "mapped_file.h"
+#include "scene_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Binary image of a parsed scene and its BVH, stored next to the scene file as <scene>.cache.
+ *
+ * The file is a header followed by flat arrays of materials, spheres, BVH nodes and BVH primitive indices.
+ * The header records the hash of the scene text and the layout of the build that wrote it, so a cache written
+ * from another version of the scene or by a build with another precision is ignored and rewritten.
+ */
+namespace scene_cache {
+    constexpr char magic[8] = {'R', 'T', 'S', 'C', 'A', 'C', 'H', 'E'};
+    constexpr uint32_t version = 2;// 2: lights and the sky setting
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t realSize;
+        uint32_t nodeSize;
+        uint32_t numMaterials;
+        uint64_t sourceHash;
+        uint32_t numSpheres;
+        uint32_t numNodes;
+        int32_t render[4];// width, height, spp, max depth, 0 if unset
+        int32_t hasSky;
+        Real camera[10];  // origin, look at, roll, vFov, aperture, focus distance
+    };
+
+    struct MaterialRecord {
+        int32_t type;
+        Real albedo[3];// emission of a light
+        Real parameter;// fuzz of a metal, index of refraction of a dielectric
+    };
+
+    struct SphereRecord {
+        Real center[3];
+        Real radius;
+        int32_t material;
+    };
+
+    static_assert(std::is_trivially_copyable_v<BvhNode>, "BVH nodes are stored as raw bytes");
+
+    /**
+     * 64-bit FNV-1a hash of the scene text.
+     */
+    inline uint64_t hashText(const std::string &text) {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (unsigned char c: text) {
+            hash = (hash ^ c) * 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    /**
+     * Reads count records of type T at offset, or returns false if the file is too short.
+     */
+    template<typename T>
+    bool readArray(const MappedFile &file, size_t &offset, size_t count, std::vector<T> &out) {
+        size_t bytes = count * sizeof(T);
+        if (offset + bytes > file.getSize()) {
+            return false;
+        }
+        out.resize(count);
+        if (bytes > 0) {
+            std::memcpy(out.data(), file.getData() + offset, bytes);
+        }
+        offset += bytes;
+        return true;
+    }
+
+    /**
+     * Whether nodes form a hierarchy that traverseBvh() can walk safely over numPrimitives primitives: leaves
+     * within the primitives, children after their parent and within the nodes, and no deeper than the traversal
+     * stack.
+     */
+    inline bool isValidHierarchy(const std::vector<BvhNode> &nodes, size_t numPrimitives) {
+        if (nodes.empty() != (numPrimitives == 0)) {
+            return false;
+        }
+        std::vector<int> depths(nodes.size(), 0);// every parent comes before its children
+        for (size_t i = 0; i < nodes.size(); i++) {
+            const auto &node = nodes[i];
+            if (node.count > 0) {
+                if (node.offset < 0 || static_cast<size_t>(node.offset) + static_cast<size_t>(node.count) > numPrimitives) {
+                    return false;
+                }
+                continue;
+            }
+            if (node.count < 0 || node.axis < 0 || node.axis > 2 || i + 1 >= nodes.size() || node.offset <= static_cast<int64_t>(i) + 1
+                || static_cast<size_t>(node.offset) >= nodes.size() || depths[i] + 1 >= BvhBuilder::maxDepth) {
+                return false;
+            }
+            depths[i + 1] = std::max(depths[i + 1], depths[i] + 1);
+            depths[node.offset] = std::max(depths[node.offset], depths[i] + 1);
+        }
+        return true;
+    }
+
+    template<typename T>
+    void writeArray(std::ostream &out, const std::vector<T> &values) {
+        out.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+    }
+
+    /**
+     * Loads a cache written for the scene text with the given hash.
+     *
+     * @return false if the cache is missing, stale or malformed.
+     */
+    bool load(const std::string &path, uint64_t sourceHash, Scene &scene) {
+        MappedFile file(path);
+        if (!file.isOpen() || file.getSize() < sizeof(Header)) {
+            return false;
+        }
+
+        Header header{};
+        std::memcpy(&header, file.getData(), sizeof(Header));
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version || header.realSize != sizeof(Real)
+            || header.nodeSize != sizeof(BvhNode) || header.sourceHash != sourceHash) {
+            return false;
+        }
+
+        size_t offset = sizeof(Header);
+        std::vector<MaterialRecord> materialRecords;
+        std::vector<SphereRecord> sphereRecords;
+        BvhBuilder::Result bvh;
+        if (!readArray(file, offset, header.numMaterials, materialRecords) || !readArray(file, offset, header.numSpheres, sphereRecords)
+            || !readArray(file, offset, header.numNodes, bvh.nodes) || !readArray(file, offset, header.numSpheres, bvh.primitiveIndices)) {
+            return false;
+        }
+        for (int index: bvh.primitiveIndices) {
+            if (index < 0 || index >= static_cast<int>(header.numSpheres)) {
+                return false;
+            }
+        }
+        if (!isValidHierarchy(bvh.nodes, header.numSpheres)) {
+            return false;
+        }
+
+        std::vector<std::shared_ptr<Material>> materials;
+        for (const auto &record: materialRecords) {
+            Color albedo(record.albedo[0], record.albedo[1], record.albedo[2]);
+            switch (static_cast<MaterialType>(record.type)) {
+                case MaterialType::Lambertian:
+                    materials.push_back(std::make_shared<Lambertian>(albedo));
+                    break;
+                case MaterialType::Metal:
+                    materials.push_back(std::make_shared<Metal>(albedo, record.parameter));
+                    break;
+                case MaterialType::Dielectric:
+                    materials.push_back(std::make_shared<Dielectric>(record.parameter));
+                    break;
+                case MaterialType::DiffuseLight:
+                    materials.push_back(std::make_shared<DiffuseLight>(albedo));
+                    break;
+                default:
+                    return false;
+            }
+        }
+
+        Scene loaded;
+        loaded.world->objects.reserve(sphereRecords.size());
+        for (const auto &record: sphereRecords) {
+            if (record.material < 0 || record.material >= static_cast<int32_t>(materials.size())) {
+                return false;
+            }
+            Point3 center(record.center[0], record.center[1], record.center[2]);
+            loaded.world->add(std::make_shared<Sphere>(center, record.radius, materials[record.material]));
+        }
+
+        auto setting = [](int32_t value) {
+            return value > 0 ? std::optional<int>(value) : std::nullopt;
+        };
+        if (header.render[0] == 1 || header.render[1] == 1) {
+            return false;// written before scene files required two pixels each way
+        }
+        loaded.render = {setting(header.render[0]), setting(header.render[1]), setting(header.render[2]), setting(header.render[3])};
+        const Real *c = header.camera;
+        loaded.camera = {Point3(c[0], c[1], c[2]), Point3(c[3], c[4], c[5]), c[6], c[7], c[8], c[9]};
+        loaded.hasSky = header.hasSky != 0;
+        loaded.bvh = std::move(bvh);
+        scene = std::move(loaded);
+        return true;
+    }
+
+    /**
+     * Writes the cache through a temporary file that is renamed into place, so readers never see a partial cache.
+     * The scene must consist of spheres with built-in materials and carry its BVH.
+     */
+    void write(const std::string &path, uint64_t sourceHash, const Scene &scene) {
+        std::vector<MaterialRecord> materialRecords;
+        std::vector<SphereRecord> sphereRecords;
+        std::unordered_map<const Material *, int32_t> materialIds;
+        for (const auto &object: scene.world->objects) {
+            auto sphere = std::dynamic_pointer_cast<Sphere>(object);
+            if (!sphere) {
+                throw std::invalid_argument("Only spheres can be cached");
+            }
+            const Material *material = sphere->getMaterial().get();
+            auto [it, inserted] = materialIds.try_emplace(material, static_cast<int32_t>(materialRecords.size()));
+            if (inserted) {
+                MaterialRecord record{static_cast<int32_t>(material->getType()), {}, 0};
+                const auto &albedo = material->getType() == MaterialType::DiffuseLight ? material->getEmission() : material->getAlbedo();
+                for (int i = 0; i < 3; i++) {
+                    record.albedo[i] = albedo[i];
+                }
+                if (material->getType() == MaterialType::Metal) {
+                    record.parameter = static_cast<const Metal *>(material)->getFuzz();
+                } else if (material->getType() == MaterialType::Dielectric) {
+                    record.parameter = static_cast<const Dielectric *>(material)->getIndexOfRefraction();
+                }
+                materialRecords.push_back(record);
+            }
+            const auto &center = sphere->getCenter();
+            sphereRecords.push_back({{center.x(), center.y(), center.z()}, sphere->getRadius(), it->second});
+        }
+
+        Header header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.realSize = sizeof(Real);
+        header.nodeSize = sizeof(BvhNode);
+        header.numMaterials = static_cast<uint32_t>(materialRecords.size());
+        header.sourceHash = sourceHash;
+        header.numSpheres = static_cast<uint32_t>(sphereRecords.size());
+        header.numNodes = static_cast<uint32_t>(scene.bvh->nodes.size());
+        const auto &render = scene.render;
+        header.render[0] = render.imageWidth.value_or(0);
+        header.render[1] = render.imageHeight.value_or(0);
+        header.render[2] = render.samplesPerPixel.value_or(0);
+        header.render[3] = render.maxDepth.value_or(0);
+        header.hasSky = scene.hasSky ? 1 : 0;
+        const auto &camera = scene.camera;
+        Real cameraValues[10] = {camera.origin.x(), camera.origin.y(), camera.origin.z(),
+                                 camera.lookAt.x(), camera.lookAt.y(), camera.lookAt.z(),
+                                 camera.roll, camera.vFov, camera.aperture, camera.focusDist};
+        std::memcpy(header.camera, cameraValues, sizeof(cameraValues));
+
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary);
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            writeArray(out, materialRecords);
+            writeArray(out, sphereRecords);
+            writeArray(out, scene.bvh->nodes);
+            writeArray(out, scene.bvh->primitiveIndices);
+            if (!out) {
+                std::remove(tempPath.c_str());
+                throw std::runtime_error("Failed to write " + tempPath);
+            }
+        }
+        std::remove(path.c_str());// rename does not replace existing files on Windows
+        if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            throw std::runtime_error("Failed to move the scene cache to " + path);
+        }
+    }
+}// namespace scene_cache
+
+/**
+ * Loads a scene file together with its BVH, from <path>.cache when that cache matches the file and otherwise by
+ * parsing the text and building the BVH, after which the cache is (re)written. Prints where the scene came from
+ * and how long that took.
+ */
+Scene loadScene(const std::string &path, bool useCache = true) {
+    auto start = std::chrono::steady_clock::now();
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    uint64_t hash = scene_cache::hashText(text);
+    std::string cachePath = path + ".cache";
+
+    Scene scene;
+    if (useCache && scene_cache::load(cachePath, hash, scene)) {
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << "Scene: " << scene.world->objects.size() << " objects loaded from " << cachePath << " in " << elapsed << " ms\n";
+        return scene;
+    }
+
+    std::istringstream textStream(text);
+    scene = parseScene(textStream, path);
+    auto parsed = std::chrono::steady_clock::now();
+    std::vector<Aabb> bounds;
+    bounds.reserve(scene.world->objects.size());
+    for (const auto &object: scene.world->objects) {
+        bounds.push_back(object->boundingBox());
+    }
+    scene.bvh = BvhBuilder().build(bounds);
+    auto built = std::chrono::steady_clock::now();
+    std::cerr << "Scene: " << scene.world->objects.size() << " objects parsed from " << path << " in "
+              << std::chrono::duration<double, std::milli>(parsed - start).count() << " ms, BVH built in "
+              << std::chrono::duration<double, std::milli>(built - parsed).count() << " ms\n";
+
+    if (useCache) {
+        try {
+            scene_cache::write(cachePath, hash, scene);
+        } catch (const std::exception &e) {
+            std::cerr << "Scene cache not written: " << e.what() << "\n";
+        }
+    }
+    return scene;
+}
+
+#endif//RAYTRACER_SCENE_CACHE_H
@@ -0,0 +1,323 @@
+#ifndef RAYTRACER_SCENE_FILE_H
+#define RAYTRACER_SCENE_FILE_H
+
+#include "bvh.h"
+#include "camera.h"
+#include "dielectric.h"
+#include "diffuse_light.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "lambertian.h"
+#include "metal.h"
+#include "obj_loader.h"
+#include "sphere.h"
+#include "util.h"
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Camera placement as written in a scene file. Angles are in degrees. The defaults are the view used by randomScene().
+ */
+struct CameraSettings {
+    Point3 origin{13, 2, 3};
+    Point3 lookAt{0, 0, 0};
+    Real roll = 0;
+    Real vFov = 20;
+    Real aperture = 0.1;
+    Real focusDist = 10;
+
+    [[nodiscard]] std::shared_ptr<Camera> build(Real aspectRatio) const {
+        auto rollRadians = static_cast<Real>(roll * pi / 180);
+        auto vFovRadians = static_cast<Real>(vFov * pi / 180);
+        return std::make_shared<Camera>(origin, lookAt - origin, rollRadians, vFovRadians, aspectRatio, aperture, focusDist);
+    }
+};
+
+/**
+ * Render settings of a scene file. Settings the file does not mention are left to the application.
+ */
+struct RenderSettings {
+    std::optional<int> imageWidth;
+    std::optional<int> imageHeight;
+    std::optional<int> samplesPerPixel;
+    std::optional<int> maxDepth;
+};
+
+struct Scene {
+    std::shared_ptr<HittableList> world = std::make_shared<HittableList>();
+    CameraSettings camera;
+    RenderSettings render;
+    bool hasSky = true;// lit by the sky gradient; without it, only emitting materials give light
+    std::optional<BvhBuilder::Result> bvh;// hierarchy over world->objects, if one was loaded with the scene
+};
+
+/**
+ * Parses the text scene format. Each line holds one statement, and '#' starts a comment:
+ *
+ *   camera origin 13 2 3 lookat 0 0 0 roll 0 vfov 20 aperture 0.1 focus 10
+ *   render width 600 height 400 spp 16 maxdepth 5
+ *   material ground lambertian 0.5 0.5 0.5
+ *   material mirror metal 0.7 0.6 0.5 0.0      # albedo, fuzz
+ *   material glass dielectric 1.5              # index of refraction
+ *   material lamp light 10 10 8                # emitted radiance
+ *   sky off                                    # no light from the sky, on by default
+ *   sphere 0 -1000 0 1000 ground               # center, radius, material
+ *   mesh models/bunny.obj glass                # OBJ file relative to the scene file, material
+ *   prototype tree models/tree.obj ground      # mesh that is only placed by instances
+ *   instance tree scale 2 2 2 rotate 0 1 0 45 translate 10 0 -3
+ *
+ * Camera and render keys are optional and may appear in any order. Materials and prototypes must be declared
+ * before use. The transforms of an instance are applied in the order written; rotate takes an axis and an angle in
+ * degrees.
+ * Throws std::runtime_error naming the offending line.
+ */
+Scene parseScene(std::istream &in, const std::string &sourceName = "scene") {
+    Scene scene;
+    std::unordered_map<std::string, std::shared_ptr<Material>> materials;
+    std::unordered_map<std::string, std::shared_ptr<Hittable>> prototypes;
+    std::string line;
+    int lineNumber = 0;
+
+    while (std::getline(in, line)) {
+        lineNumber++;
+        auto fail = [&](const std::string &message) {
+            throw std::runtime_error(sourceName + ":" + std::to_string(lineNumber) + ": " + message);
+        };
+
+        line = line.substr(0, line.find('#'));
+        std::istringstream tokens(line);
+        std::string statement;
+        if (!(tokens >> statement)) {
+            continue;
+        }
+
+        auto readReal = [&]() {
+            Real value;
+            if (!(tokens >> value)) {
+                fail("expected a number in '" + statement + "'");
+            }
+            return value;
+        };
+        auto readPoint = [&]() {
+            auto x = readReal();
+            auto y = readReal();
+            auto z = readReal();
+            return Point3(x, y, z);
+        };
+        auto readInt = [&](int minValue) {
+            int value;
+            if (!(tokens >> value) || value < minValue) {
+                fail("expected an integer of at least " + std::to_string(minValue) + " in '" + statement + "'");
+            }
+            return value;
+        };
+
+        if (statement == "camera" || statement == "render") {
+            std::string key;
+            while (tokens >> key) {
+                if (statement == "camera" && key == "origin") {
+                    scene.camera.origin = readPoint();
+                } else if (statement == "camera" && key == "lookat") {
+                    scene.camera.lookAt = readPoint();
+                } else if (statement == "camera" && key == "roll") {
+                    scene.camera.roll = readReal();
+                } else if (statement == "camera" && key == "vfov") {
+                    scene.camera.vFov = readReal();
+                } else if (statement == "camera" && key == "aperture") {
+                    scene.camera.aperture = readReal();
+                } else if (statement == "camera" && key == "focus") {
+                    scene.camera.focusDist = readReal();
+                } else if (statement == "render" && key == "width") {
+                    scene.render.imageWidth = readInt(2);// the renderer needs two pixels to span the view
+                } else if (statement == "render" && key == "height") {
+                    scene.render.imageHeight = readInt(2);
+                } else if (statement == "render" && key == "spp") {
+                    scene.render.samplesPerPixel = readInt(1);
+                } else if (statement == "render" && key == "maxdepth") {
+                    scene.render.maxDepth = readInt(1);
+                } else {
+                    fail("unknown " + statement + " setting '" + key + "'");
+                }
+            }
+        } else if (statement == "material") {
+            std::string name;
+            std::string type;
+            if (!(tokens >> name >> type)) {
+                fail("expected 'material <name> <type> ...'");
+            }
+            std::shared_ptr<Material> material;
+            if (type == "lambertian") {
+                material = std::make_shared<Lambertian>(readPoint());
+            } else if (type == "metal") {
+                auto albedo = readPoint();
+                material = std::make_shared<Metal>(albedo, readReal());
+            } else if (type == "dielectric") {
+                material = std::make_shared<Dielectric>(readReal());
+            } else if (type == "light") {
+                material = std::make_shared<DiffuseLight>(readPoint());
+            } else {
+                fail("unknown material type '" + type + "'");
+            }
+            materials[name] = material;
+        } else if (statement == "sky") {
+            std::string value;
+            if (!(tokens >> value) || (value != "on" && value != "off")) {
+                fail("expected 'sky on' or 'sky off'");
+            }
+            scene.hasSky = value == "on";
+        } else if (statement == "sphere") {
+            auto center = readPoint();
+            auto radius = readReal();
+            std::string name;
+            if (!(tokens >> name)) {
+                fail("expected a material name");
+            }
+            auto it = materials.find(name);
+            if (it == materials.end()) {
+                fail("unknown material '" + name + "'");
+            }
+            scene.world->add(std::make_shared<Sphere>(center, radius, it->second));
+        } else if (statement == "mesh" || statement == "prototype") {
+            std::string prototypeName;
+            if (statement == "prototype" && !(tokens >> prototypeName)) {
+                fail("expected a prototype name");
+            }
+            std::string objPath;
+            std::string name;
+            if (!(tokens >> objPath >> name)) {
+                fail("expected '" + statement + (statement == "prototype" ? " <name>" : "") + " <path.obj> <material>'");
+            }
+            auto it = materials.find(name);
+            if (it == materials.end()) {
+                fail("unknown material '" + name + "'");
+            }
+            std::filesystem::path resolved(objPath);
+            if (resolved.is_relative()) {
+                resolved = std::filesystem::path(sourceName).parent_path() / resolved;
+            }
+            ObjLoadStats stats;
+            auto mesh = loadObj(resolved.string(), it->second, &stats);
+            if (statement == "prototype") {
+                prototypes[prototypeName] = mesh;
+            } else {
+                scene.world->add(mesh);
+            }
+            std::cerr << "Mesh: " << stats.triangles << " triangles, " << stats.vertices << " vertices from " << resolved.string()
+                      << ", parsed in " << stats.parseMilliseconds << " ms, BVH built in " << stats.bvhMilliseconds << " ms, "
+                      << stats.meshBytes / (1024.0 * 1024.0) << " MiB\n";
+        } else if (statement == "instance") {
+            std::string name;
+            if (!(tokens >> name)) {
+                fail("expected a prototype name");
+            }
+            auto it = prototypes.find(name);
+            if (it == prototypes.end()) {
+                fail("unknown prototype '" + name + "'");
+            }
+            Transform objectToWorld;
+            std::string key;
+            while (tokens >> key) {
+                if (key == "translate") {
+                    objectToWorld = Transform::translation(readPoint()) * objectToWorld;
+                } else if (key == "scale") {
+                    objectToWorld = Transform::scaling(readPoint()) * objectToWorld;
+                } else if (key == "rotate") {
+                    auto axis = readPoint();
+                    auto angle = readReal();
+                    objectToWorld = Transform::rotation(axis, static_cast<Real>(angle * pi / 180)) * objectToWorld;
+                } else {
+                    fail("unknown transform '" + key + "'");
+                }
+            }
+            try {
+                scene.world->add(std::make_shared<Instance>(it->second, objectToWorld));
+            } catch (const std::invalid_argument &e) {
+                fail(e.what());
+            }
+        } else {
+            fail("unknown statement '" + statement + "'");
+        }
+
+        std::string extra;
+        if (tokens >> extra) {
+            fail("unexpected '" + extra + "'");
+        }
+    }
+    return scene;
+}
+
+/**
+ * Writes a scene made of spheres in the text format. Throws std::invalid_argument for other objects, including
+ * meshes, whose source file is not kept, and for other materials.
+ */
+void writeScene(std::ostream &out, const HittableList &world, const CameraSettings &camera, const RenderSettings &render,
+                bool hasSky = true) {
+    out.precision(17);
+    const auto &o = camera.origin;
+    const auto &l = camera.lookAt;
+    out << "camera origin " << o << " lookat " << l << " roll " << camera.roll << " vfov " << camera.vFov
+        << " aperture " << camera.aperture << " focus " << camera.focusDist << "\n";
+
+    std::ostringstream renderLine;
+    if (render.imageWidth) {
+        renderLine << " width " << *render.imageWidth;
+    }
+    if (render.imageHeight) {
+        renderLine << " height " << *render.imageHeight;
+    }
+    if (render.samplesPerPixel) {
+        renderLine << " spp " << *render.samplesPerPixel;
+    }
+    if (render.maxDepth) {
+        renderLine << " maxdepth " << *render.maxDepth;
+    }
+    if (!renderLine.str().empty()) {
+        out << "render" << renderLine.str() << "\n";
+    }
+    if (!hasSky) {
+        out << "sky off\n";
+    }
+
+    std::unordered_map<const Material *, std::string> names;
+    for (const auto &object: world.objects) {
+        auto sphere = std::dynamic_pointer_cast<Sphere>(object);
+        if (!sphere) {
+            throw std::invalid_argument("Only spheres can be written to a scene file");
+        }
+
+        const Material *material = sphere->getMaterial().get();
+        auto [it, inserted] = names.try_emplace(material, "m" + std::to_string(names.size()));
+        if (inserted) {
+            out << "material " << it->second << " ";
+            switch (material->getType()) {
+                case MaterialType::Lambertian:
+                    out << "lambertian " << material->getAlbedo() << "\n";
+                    break;
+                case MaterialType::Metal:
+                    out << "metal " << material->getAlbedo() << " " << static_cast<const Metal *>(material)->getFuzz() << "\n";
+                    break;
+                case MaterialType::Dielectric:
+                    out << "dielectric " << static_cast<const Dielectric *>(material)->getIndexOfRefraction() << "\n";
+                    break;
+                case MaterialType::DiffuseLight:
+                    out << "light " << material->getEmission() << "\n";
+                    break;
+                default:
+                    throw std::invalid_argument("Material cannot be written to a scene file");
+            }
+        }
+        out << "sphere " << sphere->getCenter() << " " << sphere->getRadius() << " " << it->second << "\n";
+    }
+}
+
+#endif//RAYTRACER_SCENE_FILE_H
@@ -0,0 +1,159 @@
+#ifndef RAYTRACER_SCENES_H
+#define RAYTRACER_SCENES_H
+
+#include "bvh.h"
+#include "camera.h"
+#include "closed_scene.h"
+#include "dielectric.h"
+#include "diffuse_light.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "lambertian.h"
+#include "metal.h"
+#include "scene_file.h"
+#include "sphere.h"
+#include "sphere_soa.h"
+#include "util.h"
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
+
+enum class Accelerator {
+    List,     // linear scan over the HittableList
+    Bvh,      // SAH bounding volume hierarchy
+    SphereSoA,// SIMD batch intersection over contiguous sphere arrays
+    Closed    // SAH hierarchy over variant primitives and materials, dispatched without virtual calls
+};
+
+std::shared_ptr<HittableList> randomScene(uint64_t seed = 0) {
+    std::shared_ptr<HittableList> world = std::make_shared<HittableList>();
+    Rng rng(seed);
+
+    auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    world->add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            auto chooseMat = randomDouble(rng);
+            auto offsetX = randomDouble(rng);
+            auto offsetZ = randomDouble(rng);
+            Point3 center(a + 0.9 * offsetX, 0.2, b + 0.9 * offsetZ);
+
+            if ((center - Point3(4, 0.2, 0)).length() > 0.9) {
+                shared_ptr<Material> sphereMaterial;
+
+                if (chooseMat < 0.8) {
+                    // diffuse
+                    auto albedo = Color::random(rng);
+                    albedo = albedo * Color::random(rng);
+                    sphereMaterial = make_shared<Lambertian>(albedo);
+                    world->add(make_shared<Sphere>(center, 0.2, sphereMaterial));
+                } else if (chooseMat < 0.95) {
+                    // metal
+                    auto albedo = Color::random(rng, 0.5, 1);
+                    auto fuzz = randomDouble(rng, 0, 0.5);
+                    sphereMaterial = make_shared<Metal>(albedo, fuzz);
+                    world->add(make_shared<Sphere>(center, 0.2, sphereMaterial));
+                } else {
+                    // glass
+                    sphereMaterial = make_shared<Dielectric>(1.5);
+                    world->add(make_shared<Sphere>(center, 0.2, sphereMaterial));
+                }
+            }
+        }
+    }
+
+    auto material1 = make_shared<Dielectric>(1.5);
+    world->add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+
+    auto material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
+    world->add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+    world->add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+
+    return world;
+}
+
+/**
+ * The three large spheres of randomScene() on a dark ground ring of small spheres, lit only by two small spherical
+ * lamps: a scene that scattered rays alone take thousands of samples to light, and that next-event estimation
+ * renders at a few dozen.
+ */
+Scene smallLightScene() {
+    Scene scene;
+    scene.hasSky = false;
+    auto &world = *scene.world;
+    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, make_shared<Lambertian>(Color(0.5, 0.5, 0.5))));
+    world.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, make_shared<Dielectric>(1.5)));
+    world.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, make_shared<Lambertian>(Color(0.4, 0.2, 0.1))));
+    world.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.2)));
+    for (int i = 0; i < 12; i++) {
+        double angle = 2 * pi * i / 12;
+        Point3 center(static_cast<Real>(6 * std::cos(angle)), 0.3, static_cast<Real>(6 * std::sin(angle)));
+        auto shade = static_cast<Real>(0.3 + 0.05 * i);
+        world.add(make_shared<Sphere>(center, 0.3, make_shared<Lambertian>(Color(shade, 0.8 - shade / 2, 0.4))));
+    }
+    world.add(make_shared<Sphere>(Point3(2, 3.5, 2), 0.2, make_shared<DiffuseLight>(Color(300, 260, 200))));
+    world.add(make_shared<Sphere>(Point3(-3, 2, -3), 0.1, make_shared<DiffuseLight>(Color(400, 450, 600))));
+    return scene;
+}
+
+/**
+ * Prints the BVH build time and the average traversal cost of one primary ray per pixel.
+ */
+void reportBvhStats(const Bvh &bvh, const Camera &camera, int imageWidth, int imageHeight) {
+    std::vector<Ray> rays;
+    rays.reserve(imageWidth * imageHeight);
+    Rng rng;
+    for (int row = 0; row < imageHeight; row++) {
+        for (int col = 0; col < imageWidth; col++) {
+            rays.push_back(camera.getRay(static_cast<Real>(col) / (imageWidth - 1), static_cast<Real>(row) / (imageHeight - 1), rng));
+        }
+    }
+    auto stats = bvh.measureTraversal(rays, 0.001, std::numeric_limits<Real>::infinity());
+
+    std::cerr << "BVH: " << bvh.getPrimitiveCount() << " primitives, " << bvh.getNodeCount() << " nodes, built in "
+              << bvh.getBuildTime().count() / 1000.0 << " ms\n"
+              << "BVH: " << stats.nodesPerRay() << " nodes visited and " << stats.primitiveTestsPerRay()
+              << " primitive tests per primary ray (linear scan: " << bvh.getPrimitiveCount() << ")\n";
+}
+
+/**
+ * Camera used by randomScene(): looking at the origin from (13, 2, 3) with a 20 degree vertical field of view.
+ */
+std::shared_ptr<Camera> randomSceneCamera(Real aspectRatio) {
+    return CameraSettings().build(aspectRatio);
+}
+
+/**
+ *
+ * @param prebuiltBvh hierarchy over world built earlier, e.g. loaded from a scene cache, or nullptr to build one.
+ */
+std::shared_ptr<Hittable> buildAccelerator(const std::shared_ptr<HittableList> &world, Accelerator accelerator,
+                                           const Camera &camera, int imageWidth, int imageHeight,
+                                           const BvhBuilder::Result *prebuiltBvh = nullptr) {
+    switch (accelerator) {
+        case Accelerator::List:
+            return world;
+        case Accelerator::Bvh: {
+            auto bvh = prebuiltBvh != nullptr ? std::make_shared<Bvh>(*world, *prebuiltBvh) : std::make_shared<Bvh>(*world);
+            reportBvhStats(*bvh, camera, imageWidth, imageHeight);
+            return bvh;
+        }
+        case Accelerator::SphereSoA:
+            return std::make_shared<SphereSoA>(*world);
+        case Accelerator::Closed: {
+            auto closedScene = std::make_shared<ClosedScene>(*world);
+            std::cerr << "Closed scene: " << closedScene->getPrimitiveCount() << " primitives, "
+                      << closedScene->getMaterialCount() << " sphere materials, built in "
+                      << closedScene->getBuildTime().count() / 1000.0 << " ms\n";
+            return closedScene;
+        }
+    }
+    return world;
+}
+
+#endif//RAYTRACER_SCENES_H
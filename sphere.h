@@ -3,6 +3,7 @@
 
 #include "hit_record.h"
 #include "hittable.h"
+#include "render_stats.h"
 #include <optional>
 #include <tuple>
 
@@ -10,17 +11,56 @@ class Sphere : public Hittable {
 public:
     Sphere() = default;
 
-    Sphere(const Point3 &cen, double r, const std::shared_ptr<Material> &m) : center(cen), radius(r), material(m) {}
+    Sphere(const Point3 &cen, Real r, const std::shared_ptr<Material> &m) : center(cen), radius(r), material(m) {}
 
-    [[nodiscard]] std::optional<HitRecord> hit(const Ray &r, double tMin, double tMax) const override;
+    [[nodiscard]] std::optional<Intersection> intersect(const Ray &r, Real tMin, Real tMax) const override {
+        if (auto t = intersectSphere(center, radius, r, tMin, tMax)) {
+            return Intersection{*t, this, 0};
+        }
+        return {};
+    }
+
+    [[nodiscard]] HitRecord resolve(const Ray &r, const Intersection &intersection) const override {
+        return resolveSphere(center, radius, r, intersection.t, material.get());
+    }
+
+    /**
+     * Ray parameter of the nearest hit of the sphere in [tMin, tMax], shared with containers that store spheres
+     * without Sphere objects.
+     */
+    static std::optional<Real> intersectSphere(const Point3 &center, Real radius, const Ray &r, Real tMin, Real tMax);
+
+    static HitRecord resolveSphere(const Point3 &center, Real radius, const Ray &r, Real t, const Material *material) {
+        auto p = r.at(t);
+        auto normal = (p - center) / radius;
+        return HitRecord::build(r, p, normal, t, material);
+    }
+
+    [[nodiscard]] Aabb boundingBox() const override {
+        auto r = Vec3(radius, radius, radius);
+        return {center - r, center + r};
+    }
+
+    [[nodiscard]] const Point3 &getCenter() const {
+        return center;
+    }
+
+    [[nodiscard]] Real getRadius() const {
+        return radius;
+    }
+
+    [[nodiscard]] const std::shared_ptr<Material> &getMaterial() const {
+        return material;
+    }
 
 private:
     Point3 center;
-    double radius;
+    Real radius;
     std::shared_ptr<Material> material;
 };
 
-std::optional<HitRecord> Sphere::hit(const Ray &r, double tMin, double tMax) const {
+std::optional<Real> Sphere::intersectSphere(const Point3 &center, Real radius, const Ray &r, Real tMin, Real tMax) {
+    RAYTRACER_STAT(localRenderStats.intersectionTests++);
     Vec3 oc = r.origin() - center;
     auto a = r.direction().lengthSquared();
     auto halfB = dot(oc, r.direction());
@@ -30,7 +70,7 @@ std::optional<HitRecord> Sphere::hit(const Ray &r, double tMin, double tMax) con
     if (discriminant < 0) {
         return {};
     }
-    auto sqrtd = sqrt(discriminant);
+    auto sqrtd = std::sqrt(discriminant);
 
     // Find the nearest t that lies in the acceptable range.
     auto t = (-halfB - sqrtd) / a;
@@ -40,9 +80,7 @@ std::optional<HitRecord> Sphere::hit(const Ray &r, double tMin, double tMax) con
             return {};
     }
 
-    auto p = r.at(t);
-    auto normal = (p - center) / radius;
-    return HitRecord::build(r, p, normal, t, material);
+    return t;
 }
 
 #endif//RAYTRACER_SPHERE_H
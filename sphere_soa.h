@@ -0,0 +1,315 @@
+#ifndef RAYTRACER_SPHERE_SOA_H
+#define RAYTRACER_SPHERE_SOA_H
+
+#include "hit_record.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "sphere.h"
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RAYTRACER_X86_64
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define RAYTRACER_TARGET_AVX2
+#else
+#define RAYTRACER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+enum class SimdLevel {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+/**
+ *
+ * @return the widest instruction set the sphere kernels can use on this CPU.
+ */
+inline SimdLevel detectSimdLevel() {
+#if defined(RAYTRACER_X86_64)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuidex(info, 7, 0);
+    bool hasAvx2 = (info[1] & (1 << 5)) != 0;
+#else
+    bool hasAvx2 = __builtin_cpu_supports("avx2");
+#endif
+    return hasAvx2 ? SimdLevel::Avx2 : SimdLevel::Sse2;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+/**
+ * Sphere container that keeps centers, radii and material ids in contiguous arrays and tests a ray
+ * against several spheres at a time. Only the closest hit is turned into a HitRecord.
+ *
+ * The arrays are padded to a multiple of the widest vector with NaN centers, which never produce a hit.
+ */
+class SphereSoA : public Hittable {
+public:
+    SphereSoA() : simdLevel(detectSimdLevel()) {}
+
+    /**
+     * Copies the spheres of a list. Throws std::invalid_argument if the list holds anything other than spheres.
+     */
+    explicit SphereSoA(const HittableList &list) : SphereSoA() {
+        for (const auto &object: list.objects) {
+            auto sphere = std::dynamic_pointer_cast<Sphere>(object);
+            if (!sphere) {
+                throw std::invalid_argument("SphereSoA can only hold spheres");
+            }
+            add(sphere->getCenter(), sphere->getRadius(), sphere->getMaterial());
+        }
+    }
+
+    void add(const Point3 &center, Real radius, const std::shared_ptr<Material> &material) {
+        // Overwrite the first padding slot, then restore the padding.
+        resizeArrays(count);
+        centerX.push_back(center.x());
+        centerY.push_back(center.y());
+        centerZ.push_back(center.z());
+        radii.push_back(radius);
+        radiiSquared.push_back(radius * radius);
+        materialIds.push_back(materialId(material));
+        count++;
+        auto extent = Vec3(radius, radius, radius);
+        bounds.expand(Aabb(center - extent, center + extent));
+        resizeArrays(paddedSize(count));
+    }
+
+    [[nodiscard]] std::optional<Intersection> intersect(const Ray &r, Real tMin, Real tMax) const override {
+        RAYTRACER_STAT(localRenderStats.intersectionTests += count);
+        int index;
+        double nearest = tMax;
+        switch (simdLevel) {
+#if defined(RAYTRACER_X86_64)
+            case SimdLevel::Avx2:
+                index = closestAvx2(r, tMin, nearest);
+                break;
+            case SimdLevel::Sse2:
+                index = closestSse2(r, tMin, nearest);
+                break;
+#endif
+            default:
+                index = closestScalar(r, tMin, nearest);
+                break;
+        }
+
+        if (index < 0) {
+            return {};
+        }
+        return Intersection{static_cast<Real>(nearest), this, index};
+    }
+
+    [[nodiscard]] HitRecord resolve(const Ray &r, const Intersection &intersection) const override {
+        int index = intersection.index;
+        Point3 center(centerX[index], centerY[index], centerZ[index]);
+        auto p = r.at(intersection.t);
+        auto normal = (p - center) / radii[index];
+        return HitRecord::build(r, p, normal, intersection.t, materials[materialIds[index]].get());
+    }
+
+    [[nodiscard]] Aabb boundingBox() const override {
+        return bounds;
+    }
+
+    [[nodiscard]] int size() const {
+        return count;
+    }
+
+    [[nodiscard]] SimdLevel getSimdLevel() const {
+        return simdLevel;
+    }
+
+    /**
+     * Forces a kernel, e.g. for benchmarking. Levels the CPU does not support fall back to the detected level.
+     */
+    void setSimdLevel(SimdLevel level) {
+        simdLevel = std::min(level, detectSimdLevel());
+    }
+
+private:
+    static constexpr int maxLanes = 4;
+
+    std::vector<double> centerX;
+    std::vector<double> centerY;
+    std::vector<double> centerZ;
+    std::vector<double> radii;
+    std::vector<double> radiiSquared;
+    std::vector<int> materialIds;
+    std::vector<std::shared_ptr<Material>> materials;
+    std::unordered_map<const Material *, int> materialIndex;
+    Aabb bounds;
+    int count = 0;
+    SimdLevel simdLevel;
+
+    static int paddedSize(int n) {
+        return (n + maxLanes - 1) / maxLanes * maxLanes;
+    }
+
+    void resizeArrays(int n) {
+        const auto nan = std::numeric_limits<double>::quiet_NaN();
+        centerX.resize(n, nan);
+        centerY.resize(n, nan);
+        centerZ.resize(n, nan);
+        radii.resize(n, 0);
+        radiiSquared.resize(n, 0);
+        materialIds.resize(n, 0);
+    }
+
+    int materialId(const std::shared_ptr<Material> &material) {
+        auto [it, inserted] = materialIndex.try_emplace(material.get(), static_cast<int>(materials.size()));
+        if (inserted) {
+            materials.push_back(material);
+        }
+        return it->second;
+    }
+
+    /**
+     * Each kernel returns the index of the closest sphere hit in [tMin, tMax], or -1, and narrows tMax to its distance.
+     */
+    int closestScalar(const Ray &r, double tMin, double &tMax) const {
+        auto orig = r.origin();
+        auto dir = r.direction();
+        auto a = dir.lengthSquared();
+        int result = -1;
+
+        for (int i = 0; i < count; i++) {
+            Vec3 oc = orig - Point3(centerX[i], centerY[i], centerZ[i]);
+            auto halfB = dot(oc, dir);
+            auto c = oc.lengthSquared() - radiiSquared[i];
+            auto discriminant = halfB * halfB - a * c;
+            if (discriminant < 0) {
+                continue;
+            }
+            auto sqrtd = std::sqrt(discriminant);
+            auto t = (-halfB - sqrtd) / a;
+            if (t < tMin || tMax < t) {
+                t = (-halfB + sqrtd) / a;
+                if (t < tMin || tMax < t) {
+                    continue;
+                }
+            }
+            tMax = t;
+            result = i;
+        }
+        return result;
+    }
+
+#if defined(RAYTRACER_X86_64)
+    int closestSse2(const Ray &r, double tMin, double &tMax) const {
+        auto orig = r.origin();
+        auto dir = r.direction();
+        const __m128d ox = _mm_set1_pd(orig.x()), oy = _mm_set1_pd(orig.y()), oz = _mm_set1_pd(orig.z());
+        const __m128d dx = _mm_set1_pd(dir.x()), dy = _mm_set1_pd(dir.y()), dz = _mm_set1_pd(dir.z());
+        const __m128d a = _mm_set1_pd(dir.lengthSquared());
+        const __m128d lo = _mm_set1_pd(tMin);
+        const __m128d zero = _mm_setzero_pd();
+        __m128d best = _mm_set1_pd(tMax);
+        __m128d bestIndex = _mm_set1_pd(-1);
+        __m128d index = _mm_set_pd(1, 0);
+        const __m128d step = _mm_set1_pd(2);
+
+        auto select = [](__m128d mask, __m128d ifTrue, __m128d ifFalse) {
+            return _mm_or_pd(_mm_and_pd(mask, ifTrue), _mm_andnot_pd(mask, ifFalse));
+        };
+
+        for (int i = 0; i < count; i += 2, index = _mm_add_pd(index, step)) {
+            __m128d ocx = _mm_sub_pd(ox, _mm_loadu_pd(&centerX[i]));
+            __m128d ocy = _mm_sub_pd(oy, _mm_loadu_pd(&centerY[i]));
+            __m128d ocz = _mm_sub_pd(oz, _mm_loadu_pd(&centerZ[i]));
+            __m128d halfB = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, dx), _mm_mul_pd(ocy, dy)), _mm_mul_pd(ocz, dz));
+            __m128d ocLengthSquared = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)), _mm_mul_pd(ocz, ocz));
+            __m128d c = _mm_sub_pd(ocLengthSquared, _mm_loadu_pd(&radiiSquared[i]));
+            __m128d discriminant = _mm_sub_pd(_mm_mul_pd(halfB, halfB), _mm_mul_pd(a, c));
+            __m128d hasRoots = _mm_cmpge_pd(discriminant, zero);
+            if (_mm_movemask_pd(hasRoots) == 0) {
+                continue;
+            }
+
+            __m128d sqrtd = _mm_sqrt_pd(_mm_max_pd(discriminant, zero));
+            __m128d t0 = _mm_div_pd(_mm_sub_pd(_mm_sub_pd(zero, halfB), sqrtd), a);
+            __m128d t1 = _mm_div_pd(_mm_add_pd(_mm_sub_pd(zero, halfB), sqrtd), a);
+            __m128d t0Valid = _mm_and_pd(_mm_cmpge_pd(t0, lo), _mm_cmple_pd(t0, best));
+            __m128d t1Valid = _mm_and_pd(_mm_cmpge_pd(t1, lo), _mm_cmple_pd(t1, best));
+            __m128d t = select(t0Valid, t0, t1);
+            __m128d isHit = _mm_and_pd(hasRoots, _mm_or_pd(t0Valid, t1Valid));
+
+            best = select(isHit, t, best);
+            bestIndex = select(isHit, index, bestIndex);
+        }
+
+        alignas(16) double bests[2];
+        alignas(16) double indices[2];
+        _mm_store_pd(bests, best);
+        _mm_store_pd(indices, bestIndex);
+        return reduceLanes(bests, indices, 2, tMax);
+    }
+
+    RAYTRACER_TARGET_AVX2 int closestAvx2(const Ray &r, double tMin, double &tMax) const {
+        auto orig = r.origin();
+        auto dir = r.direction();
+        const __m256d ox = _mm256_set1_pd(orig.x()), oy = _mm256_set1_pd(orig.y()), oz = _mm256_set1_pd(orig.z());
+        const __m256d dx = _mm256_set1_pd(dir.x()), dy = _mm256_set1_pd(dir.y()), dz = _mm256_set1_pd(dir.z());
+        const __m256d a = _mm256_set1_pd(dir.lengthSquared());
+        const __m256d lo = _mm256_set1_pd(tMin);
+        const __m256d zero = _mm256_setzero_pd();
+        __m256d best = _mm256_set1_pd(tMax);
+        __m256d bestIndex = _mm256_set1_pd(-1);
+        __m256d index = _mm256_set_pd(3, 2, 1, 0);
+        const __m256d step = _mm256_set1_pd(4);
+
+        for (int i = 0; i < count; i += 4, index = _mm256_add_pd(index, step)) {
+            __m256d ocx = _mm256_sub_pd(ox, _mm256_loadu_pd(&centerX[i]));
+            __m256d ocy = _mm256_sub_pd(oy, _mm256_loadu_pd(&centerY[i]));
+            __m256d ocz = _mm256_sub_pd(oz, _mm256_loadu_pd(&centerZ[i]));
+            __m256d halfB = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, dx), _mm256_mul_pd(ocy, dy)), _mm256_mul_pd(ocz, dz));
+            __m256d ocLengthSquared = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz));
+            __m256d c = _mm256_sub_pd(ocLengthSquared, _mm256_loadu_pd(&radiiSquared[i]));
+            __m256d discriminant = _mm256_sub_pd(_mm256_mul_pd(halfB, halfB), _mm256_mul_pd(a, c));
+            __m256d hasRoots = _mm256_cmp_pd(discriminant, zero, _CMP_GE_OQ);
+            if (_mm256_movemask_pd(hasRoots) == 0) {
+                continue;
+            }
+
+            __m256d sqrtd = _mm256_sqrt_pd(_mm256_max_pd(discriminant, zero));
+            __m256d t0 = _mm256_div_pd(_mm256_sub_pd(_mm256_sub_pd(zero, halfB), sqrtd), a);
+            __m256d t1 = _mm256_div_pd(_mm256_add_pd(_mm256_sub_pd(zero, halfB), sqrtd), a);
+            __m256d t0Valid = _mm256_and_pd(_mm256_cmp_pd(t0, lo, _CMP_GE_OQ), _mm256_cmp_pd(t0, best, _CMP_LE_OQ));
+            __m256d t1Valid = _mm256_and_pd(_mm256_cmp_pd(t1, lo, _CMP_GE_OQ), _mm256_cmp_pd(t1, best, _CMP_LE_OQ));
+            __m256d t = _mm256_blendv_pd(t1, t0, t0Valid);
+            __m256d isHit = _mm256_and_pd(hasRoots, _mm256_or_pd(t0Valid, t1Valid));
+
+            best = _mm256_blendv_pd(best, t, isHit);
+            bestIndex = _mm256_blendv_pd(bestIndex, index, isHit);
+        }
+
+        alignas(32) double bests[4];
+        alignas(32) double indices[4];
+        _mm256_store_pd(bests, best);
+        _mm256_store_pd(indices, bestIndex);
+        return reduceLanes(bests, indices, 4, tMax);
+    }
+
+    static int reduceLanes(const double *bests, const double *indices, int lanes, double &tMax) {
+        int result = -1;
+        for (int lane = 0; lane < lanes; lane++) {
+            if (indices[lane] >= 0 && (result < 0 || bests[lane] < tMax)) {
+                tMax = bests[lane];
+                result = static_cast<int>(indices[lane]);
+            }
+        }
+        return result;
+    }
+#endif
+};
+
+#endif//RAYTRACER_SPHERE_SOA_H
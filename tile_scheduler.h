@@ -0,0 +1,275 @@
+#ifndef RAYTRACER_TILE_SCHEDULER_H
+#define RAYTRACER_TILE_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/**
+ * Rectangle of pixels [x0, x1) x [y0, y1) in image storage order (row 0 is the top of the image).
+ */
+struct Tile {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+
+    [[nodiscard]] int width() const { return x1 - x0; }
+
+    [[nodiscard]] int height() const { return y1 - y0; }
+
+    [[nodiscard]] int numPixels() const { return width() * height(); }
+};
+
+/**
+ * Persistent pool of render workers that process an image tile by tile.
+ *
+ * Each pass splits the image into square tiles and hands every worker a contiguous block of them in its own deque.
+ * Workers take tiles from the front of their own deque and, once it runs dry, steal from the back of the others.
+ * Cancellation is checked before every tile, so a cancelled pass stops at the next tile boundary.
+ */
+class TileScheduler {
+public:
+    using Job = std::function<void(const Tile &tile, int worker)>;
+
+    struct Stats {
+        int tilesTotal = 0;
+        int tilesCompleted = 0;
+        int steals = 0;
+        int numThreads = 0;
+        std::chrono::microseconds wallTime{0};
+        std::chrono::microseconds idleTime{0};// summed over all workers
+
+        [[nodiscard]] double tilesPerSecond() const {
+            return wallTime.count() > 0 ? tilesCompleted * 1e6 / wallTime.count() : 0;
+        }
+
+        /**
+         *
+         * @return the fraction of the workers' time spent waiting for or looking for work.
+         */
+        [[nodiscard]] double idleFraction() const {
+            auto total = static_cast<double>(wallTime.count()) * numThreads;
+            return total > 0 ? idleTime.count() / total : 0;
+        }
+    };
+
+    /**
+     *
+     * @param numThreads number of workers, or 0 to use one per hardware thread.
+     */
+    explicit TileScheduler(int numThreads = 0, int tileSize = 32) : numThreads(resolveThreadCount(numThreads)),
+                                                                     tileSize(tileSize) {
+        for (int i = 0; i < this->numThreads; i++) {
+            queues.push_back(std::make_unique<WorkQueue>());
+        }
+        for (int i = 0; i < this->numThreads; i++) {
+            threads.emplace_back([this, i]() { workerLoop(i); });
+        }
+    }
+
+    TileScheduler(const TileScheduler &) = delete;
+
+    TileScheduler &operator=(const TileScheduler &) = delete;
+
+    ~TileScheduler() {
+        std::unique_lock<std::mutex> lock(mutex);
+        isExiting = true;
+        lock.unlock();
+        workCond.notify_all();
+        for (auto &thread: threads) {
+            thread.join();
+        }
+    }
+
+    /**
+     * Runs job on every tile of a width x height image and blocks until all tiles are done or cancel is set.
+     *
+     * @return false if the pass was cancelled before every tile was processed.
+     */
+    bool run(int width, int height, const Job &job, const std::atomic_bool &cancel) {
+        std::lock_guard<std::mutex> runLock(runMutex);
+        auto tiles = makeTiles(width, height);
+
+        // Give every worker a contiguous block of tiles so neighbouring tiles are usually rendered by the same thread.
+        for (int w = 0; w < numThreads; w++) {
+            auto begin = tiles.size() * w / numThreads;
+            auto end = tiles.size() * (w + 1) / numThreads;
+            std::lock_guard<std::mutex> queueLock(queues[w]->mutex);
+            queues[w]->tiles.assign(tiles.begin() + begin, tiles.begin() + end);
+        }
+
+        tilesCompleted = 0;
+        steals = 0;
+        busyMicros = 0;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::unique_lock<std::mutex> lock(mutex);
+        currentJob = &job;
+        currentCancel = &cancel;
+        workersFinished = 0;
+        generation++;
+        lock.unlock();
+        workCond.notify_all();
+
+        lock.lock();
+        doneCond.wait(lock, [this] { return workersFinished == numThreads; });
+        currentJob = nullptr;
+        currentCancel = nullptr;
+        lock.unlock();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        // Drop whatever a cancelled pass left behind.
+        for (auto &queue: queues) {
+            std::lock_guard<std::mutex> queueLock(queue->mutex);
+            queue->tiles.clear();
+        }
+
+        auto wallTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+        std::lock_guard<std::mutex> statsLock(statsMutex);
+        lastStats.tilesTotal = static_cast<int>(tiles.size());
+        lastStats.tilesCompleted = tilesCompleted;
+        lastStats.steals = steals;
+        lastStats.numThreads = numThreads;
+        lastStats.wallTime = wallTime;
+        lastStats.idleTime = std::chrono::microseconds(std::max(0LL, static_cast<long long>(wallTime.count()) * numThreads - busyMicros));
+        return lastStats.tilesCompleted == lastStats.tilesTotal;
+    }
+
+    [[nodiscard]] Stats getLastStats() const {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        return lastStats;
+    }
+
+    [[nodiscard]] int getNumThreads() const {
+        return numThreads;
+    }
+
+    [[nodiscard]] int getTileSize() const {
+        return tileSize;
+    }
+
+    void setTileSize(int size) {
+        tileSize = std::max(1, size);
+    }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Tile> tiles;
+    };
+
+    const int numThreads;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic_int tileSize;
+
+    std::mutex runMutex;
+    std::mutex mutex;
+    std::condition_variable workCond;
+    std::condition_variable doneCond;
+    unsigned long long generation = 0;
+    int workersFinished = 0;
+    bool isExiting = false;
+    const Job *currentJob = nullptr;
+    const std::atomic_bool *currentCancel = nullptr;
+
+    std::atomic_int tilesCompleted = 0;
+    std::atomic_int steals = 0;
+    std::atomic<long long> busyMicros = 0;
+
+    mutable std::mutex statsMutex;
+    Stats lastStats;
+
+    static int resolveThreadCount(int requested) {
+        return requested > 0 ? requested : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    [[nodiscard]] std::vector<Tile> makeTiles(int width, int height) const {
+        std::vector<Tile> tiles;
+        int size = tileSize;
+        for (int y = 0; y < height; y += size) {
+            for (int x = 0; x < width; x += size) {
+                tiles.push_back({x, y, std::min(x + size, width), std::min(y + size, height)});
+            }
+        }
+        return tiles;
+    }
+
+    void workerLoop(int id) {
+        unsigned long long seenGeneration = 0;
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            workCond.wait(lock, [this, seenGeneration] { return isExiting || generation != seenGeneration; });
+            if (isExiting) {
+                return;
+            }
+            seenGeneration = generation;
+            const Job &job = *currentJob;
+            const std::atomic_bool &cancel = *currentCancel;
+            lock.unlock();
+
+            processTiles(id, job, cancel);
+
+            lock.lock();
+            if (++workersFinished == numThreads) {
+                doneCond.notify_all();
+            }
+        }
+    }
+
+    void processTiles(int id, const Job &job, const std::atomic_bool &cancel) {
+        long long busy = 0;
+        while (!cancel) {
+            auto tile = popLocal(id);
+            if (!tile) {
+                tile = steal(id);
+            }
+            if (!tile) {
+                break;
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            job(*tile, id);
+            auto end = std::chrono::high_resolution_clock::now();
+            busy += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            tilesCompleted++;
+        }
+        busyMicros += busy;
+    }
+
+    std::optional<Tile> popLocal(int id) {
+        auto &queue = *queues[id];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tiles.empty()) {
+            return {};
+        }
+        auto tile = queue.tiles.front();
+        queue.tiles.pop_front();
+        return tile;
+    }
+
+    std::optional<Tile> steal(int id) {
+        for (int i = 1; i < numThreads; i++) {
+            auto &victim = *queues[(id + i) % numThreads];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tiles.empty()) {
+                auto tile = victim.tiles.back();
+                victim.tiles.pop_back();
+                steals++;
+                return tile;
+            }
+        }
+        return {};
+    }
+};
+
+#endif//RAYTRACER_TILE_SCHEDULER_H
@@ -0,0 +1,137 @@
+#ifndef RAYTRACER_TRANSFORM_H
+#define RAYTRACER_TRANSFORM_H
+
+#include "aabb.h"
+#include "vec3.h"
+#include <cmath>
+#include <stdexcept>
+
+/**
+ * Affine transform stored as the top three rows of a 4x4 matrix.
+ */
+class Transform {
+public:
+    Transform() : m{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}} {}
+
+    static Transform translation(const Vec3 &offset) {
+        Transform t;
+        for (int i = 0; i < 3; i++) {
+            t.m[i][3] = offset[i];
+        }
+        return t;
+    }
+
+    static Transform scaling(const Vec3 &factors) {
+        Transform t;
+        for (int i = 0; i < 3; i++) {
+            t.m[i][i] = factors[i];
+        }
+        return t;
+    }
+
+    /**
+     * Counter-clockwise rotation by angle (in radians) about axis, seen from the tip of the axis.
+     */
+    static Transform rotation(const Vec3 &axis, Real angle) {
+        auto a = unitVector(axis);
+        Real c = std::cos(angle);
+        Real s = std::sin(angle);
+        Real k = 1 - c;
+        Transform t;
+        t.m[0][0] = c + a.x() * a.x() * k;
+        t.m[0][1] = a.x() * a.y() * k - a.z() * s;
+        t.m[0][2] = a.x() * a.z() * k + a.y() * s;
+        t.m[1][0] = a.y() * a.x() * k + a.z() * s;
+        t.m[1][1] = c + a.y() * a.y() * k;
+        t.m[1][2] = a.y() * a.z() * k - a.x() * s;
+        t.m[2][0] = a.z() * a.x() * k - a.y() * s;
+        t.m[2][1] = a.z() * a.y() * k + a.x() * s;
+        t.m[2][2] = c + a.z() * a.z() * k;
+        return t;
+    }
+
+    /**
+     * Composition that applies other first and then this transform.
+     */
+    friend Transform operator*(const Transform &a, const Transform &b) {
+        Transform t;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 4; j++) {
+                t.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + (j == 3 ? a.m[i][3] : 0);
+            }
+        }
+        return t;
+    }
+
+    /**
+     * Throws std::invalid_argument if the transform is singular.
+     */
+    [[nodiscard]] Transform inverse() const {
+        // Inverse of the linear part by cofactors; the translation is then moved to the other side.
+        Real c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+        Real c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+        Real c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+        Real det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+        if (det == 0) {
+            throw std::invalid_argument("Transform is not invertible");
+        }
+        Real invDet = 1 / det;
+
+        Transform t;
+        t.m[0][0] = c00 * invDet;
+        t.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+        t.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+        t.m[1][0] = c01 * invDet;
+        t.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+        t.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+        t.m[2][0] = c02 * invDet;
+        t.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+        t.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+        for (int i = 0; i < 3; i++) {
+            t.m[i][3] = -(t.m[i][0] * m[0][3] + t.m[i][1] * m[1][3] + t.m[i][2] * m[2][3]);
+        }
+        return t;
+    }
+
+    [[nodiscard]] Point3 applyToPoint(const Point3 &p) const {
+        return applyToVector(p) + Vec3(m[0][3], m[1][3], m[2][3]);
+    }
+
+    [[nodiscard]] Vec3 applyToVector(const Vec3 &v) const {
+        return {m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+                m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+                m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z()};
+    }
+
+    /**
+     * Multiplies v by the transpose of the linear part. Normals are transformed by the inverse transpose, so this
+     * maps a normal back through the inverse of this transform.
+     */
+    [[nodiscard]] Vec3 applyTransposedToVector(const Vec3 &v) const {
+        return {m[0][0] * v.x() + m[1][0] * v.y() + m[2][0] * v.z(),
+                m[0][1] * v.x() + m[1][1] * v.y() + m[2][1] * v.z(),
+                m[0][2] * v.x() + m[1][2] * v.y() + m[2][2] * v.z()};
+    }
+
+    /**
+     * Smallest box containing the transformed corners of box.
+     */
+    [[nodiscard]] Aabb applyToBox(const Aabb &box) const {
+        Aabb result;
+        if (box.isEmpty()) {
+            return result;
+        }
+        for (int corner = 0; corner < 8; corner++) {
+            Point3 p((corner & 1 ? box.max() : box.min()).x(),
+                     (corner & 2 ? box.max() : box.min()).y(),
+                     (corner & 4 ? box.max() : box.min()).z());
+            result.expand(applyToPoint(p));
+        }
+        return result;
+    }
+
+private:
+    Real m[3][4];
+};
+
+#endif//RAYTRACER_TRANSFORM_H
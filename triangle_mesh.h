@@ -0,0 +1,233 @@
+#ifndef RAYTRACER_TRIANGLE_MESH_H
+#define RAYTRACER_TRIANGLE_MESH_H
+
+#include "bvh.h"
+#include "hit_record.h"
+#include "hittable.h"
+#include "render_stats.h"
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Indexed triangle mesh. Vertex positions, vertex normals and the three indices of every triangle are kept in
+ * shared contiguous buffers, and the mesh carries its own BVH over its triangles, so a mesh is a single object
+ * to the scene's acceleration structure.
+ *
+ * Rays are tested with the watertight algorithm of Woop, Benthin and Wald ("Watertight Ray/Triangle
+ * Intersection", JCGT 2013), which never lets a ray slip through the shared edge or vertex of two triangles.
+ */
+class TriangleMesh : public Hittable {
+public:
+    struct Buffers {
+        std::vector<Point3> positions;
+        std::vector<Vec3> normals;
+        std::vector<int> indices;      // three position indices per triangle, counter-clockwise seen from outside
+        std::vector<int> normalIndices;// three normal indices per triangle or empty; -1 uses the face normal
+    };
+
+    TriangleMesh(Buffers buffers, const std::shared_ptr<Material> &m, int maxLeafSize = 4)
+        : buffers(std::move(buffers)), material(m) {
+        auto start = std::chrono::high_resolution_clock::now();
+        buildBvh(maxLeafSize);
+        auto end = std::chrono::high_resolution_clock::now();
+        buildTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    }
+
+    [[nodiscard]] std::optional<Intersection> intersect(const Ray &r, Real tMin, Real tMax) const override {
+        WatertightRay ray(r);
+        return traverseBvh(nodes, r, tMin, tMax, [&](int triangle, Real nearestHitDist) -> std::optional<Intersection> {
+            RAYTRACER_STAT(localRenderStats.intersectionTests++);
+            Vec3 barycentrics;
+            if (auto t = intersectTriangle(ray, triangle, tMin, nearestHitDist, barycentrics)) {
+                return Intersection{*t, this, triangle};
+            }
+            return {};
+        });
+    }
+
+    [[nodiscard]] HitRecord resolve(const Ray &r, const Intersection &intersection) const override {
+        int triangle = intersection.index;
+        const int *index = &buffers.indices[3 * triangle];
+        const auto &p0 = buffers.positions[index[0]];
+        const auto &p1 = buffers.positions[index[1]];
+        const auto &p2 = buffers.positions[index[2]];
+        Vec3 faceNormal = unitVector(cross(p1 - p0, p2 - p0));
+
+        Vec3 normal = faceNormal;
+        if (!buffers.normalIndices.empty()) {
+            const int *normalIndex = &buffers.normalIndices[3 * triangle];
+            if (normalIndex[0] >= 0 && normalIndex[1] >= 0 && normalIndex[2] >= 0) {
+                // Same test as intersect(), repeated only for the final hit to get the interpolation weights.
+                Vec3 w;
+                intersectTriangle(WatertightRay(r), triangle, -std::numeric_limits<Real>::infinity(),
+                                  std::numeric_limits<Real>::infinity(), w);
+                normal = unitVector(w.x() * buffers.normals[normalIndex[0]] + w.y() * buffers.normals[normalIndex[1]]
+                                    + w.z() * buffers.normals[normalIndex[2]]);
+            }
+        }
+
+        // The face normal decides which side was hit; the shading normal is turned to that side.
+        bool isFrontFace = dot(r.direction(), faceNormal) < 0;
+        if ((dot(normal, faceNormal) < 0) == isFrontFace) {
+            normal = -normal;
+        }
+        return {r.at(intersection.t), normal, intersection.t, isFrontFace, material.get()};
+    }
+
+    [[nodiscard]] Aabb boundingBox() const override {
+        return nodes.empty() ? Aabb() : nodes[0].bounds;
+    }
+
+    [[nodiscard]] int getTriangleCount() const {
+        return static_cast<int>(buffers.indices.size() / 3);
+    }
+
+    [[nodiscard]] int getVertexCount() const {
+        return static_cast<int>(buffers.positions.size());
+    }
+
+    [[nodiscard]] const Buffers &getBuffers() const {
+        return buffers;
+    }
+
+    [[nodiscard]] const std::shared_ptr<Material> &getMaterial() const {
+        return material;
+    }
+
+    [[nodiscard]] std::chrono::microseconds getBuildTime() const {
+        return buildTime;
+    }
+
+    /**
+     * Bytes held by the vertex, index and BVH buffers.
+     */
+    [[nodiscard]] size_t memoryFootprint() const {
+        return buffers.positions.capacity() * sizeof(Point3) + buffers.normals.capacity() * sizeof(Vec3)
+               + buffers.indices.capacity() * sizeof(int) + buffers.normalIndices.capacity() * sizeof(int)
+               + nodes.capacity() * sizeof(BvhNode);
+    }
+
+private:
+    /**
+     * Ray transformed once per mesh so that it points along +z: the triangle tests then reduce to 2D edge
+     * functions in the xy plane.
+     */
+    struct WatertightRay {
+        Point3 origin;
+        int kx, ky, kz;// permutation of the axes; kz is the dominant direction axis
+        Real sx, sy, sz;
+
+        explicit WatertightRay(const Ray &r) : origin(r.origin()) {
+            const auto &d = r.direction();
+            kz = 0;
+            for (int axis = 1; axis < 3; axis++) {
+                if (std::abs(d[axis]) > std::abs(d[kz])) {
+                    kz = axis;
+                }
+            }
+            kx = kz == 2 ? 0 : kz + 1;
+            ky = kx == 2 ? 0 : kx + 1;
+            if (d[kz] < 0) {
+                std::swap(kx, ky);// keep the winding of the projected triangles
+            }
+            sx = d[kx] / d[kz];
+            sy = d[ky] / d[kz];
+            sz = 1 / d[kz];
+        }
+    };
+
+    Buffers buffers;
+    std::shared_ptr<Material> material;
+    std::vector<BvhNode> nodes;
+    std::chrono::microseconds buildTime{0};
+
+    /**
+     * Builds the BVH and stores the triangles in leaf order, so leaves index the buffers directly.
+     */
+    void buildBvh(int maxLeafSize) {
+        int numTriangles = getTriangleCount();
+        std::vector<Aabb> bounds(numTriangles);
+        for (int i = 0; i < numTriangles; i++) {
+            for (int j = 0; j < 3; j++) {
+                bounds[i].expand(buffers.positions[buffers.indices[3 * i + j]]);
+            }
+        }
+        auto result = BvhBuilder(maxLeafSize).build(bounds);
+        bounds = {};
+
+        auto reorder = [&](std::vector<int> &perTriangle) {
+            if (perTriangle.empty()) {
+                return;
+            }
+            std::vector<int> sorted(perTriangle.size());
+            for (int i = 0; i < numTriangles; i++) {
+                int source = result.primitiveIndices[i];
+                for (int j = 0; j < 3; j++) {
+                    sorted[3 * i + j] = perTriangle[3 * source + j];
+                }
+            }
+            perTriangle = std::move(sorted);
+        };
+        reorder(buffers.indices);
+        reorder(buffers.normalIndices);
+        nodes = std::move(result.nodes);
+    }
+
+    /**
+     * Returns the distance to the triangle if it is within [tMin, tMax]. barycentrics receives the weights of the
+     * three vertices whenever the ray passes through the triangle.
+     */
+    std::optional<Real> intersectTriangle(const WatertightRay &ray, int triangle, Real tMin, Real tMax, Vec3 &barycentrics) const {
+        const int *index = &buffers.indices[3 * triangle];
+        Vec3 a = buffers.positions[index[0]] - ray.origin;
+        Vec3 b = buffers.positions[index[1]] - ray.origin;
+        Vec3 c = buffers.positions[index[2]] - ray.origin;
+
+        Real ax = a[ray.kx] - ray.sx * a[ray.kz];
+        Real ay = a[ray.ky] - ray.sy * a[ray.kz];
+        Real bx = b[ray.kx] - ray.sx * b[ray.kz];
+        Real by = b[ray.ky] - ray.sy * b[ray.kz];
+        Real cx = c[ray.kx] - ray.sx * c[ray.kz];
+        Real cy = c[ray.ky] - ray.sy * c[ray.kz];
+
+        Real u = cx * by - cy * bx;
+        Real v = ax * cy - ay * cx;
+        Real w = bx * ay - by * ax;
+
+        // An edge function of exactly zero is ambiguous in single precision; recompute it with doubles.
+        if constexpr (std::is_same_v<Real, float>) {
+            if (u == 0 || v == 0 || w == 0) {
+                u = static_cast<Real>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+                v = static_cast<Real>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+                w = static_cast<Real>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+            }
+        }
+
+        if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) {
+            return {};
+        }
+        Real det = u + v + w;
+        if (det == 0) {
+            return {};
+        }
+
+        Real az = ray.sz * a[ray.kz];
+        Real bz = ray.sz * b[ray.kz];
+        Real cz = ray.sz * c[ray.kz];
+        Real invDet = 1 / det;
+        Real t = (u * az + v * bz + w * cz) * invDet;
+        barycentrics = Vec3(u * invDet, v * invDet, w * invDet);
+        if (t < tMin || tMax < t) {
+            return {};
+        }
+        return t;
+    }
+};
+
+#endif//RAYTRACER_TRIANGLE_MESH_H
@@ -1,25 +1,25 @@
 #ifndef RAYTRACER_UTIL_H
 #define RAYTRACER_UTIL_H
 
+#include "rng.h"
 #include <algorithm>
-#include <random>
+
+constexpr double pi = 3.14159265358979323846;
 
 /**
  *
  * @return A random real in [0,1).
  */
-inline double randomDouble() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+inline double randomDouble(Rng &rng) {
+    return rng.nextDouble();
 }
 
 /**
  *
  * @return A random real in [min,max).
  */
-inline double randomDouble(double min, double max) {
-    return min + (max - min) * randomDouble();
+inline double randomDouble(Rng &rng, double min, double max) {
+    return min + (max - min) * randomDouble(rng);
 }
 
 #endif//RAYTRACER_UTIL_H
@@ -8,56 +8,77 @@
 #include <optional>
 #include <ostream>
 
-class Vec3 {
+/**
+ * Scalar type of the math core, selected at build time with RAYTRACER_USE_FLOAT.
+ */
+#ifdef RAYTRACER_USE_FLOAT
+using Real = float;
+#else
+using Real = double;
+#endif
+
+template<typename T>
+class Vec3T {
 public:
-    inline static Vec3 random() {
-        return {randomDouble(), randomDouble(), randomDouble()};
+    using Scalar = T;
+
+    inline static Vec3T random(Rng &rng) {
+        auto x = static_cast<T>(randomDouble(rng));
+        auto y = static_cast<T>(randomDouble(rng));
+        auto z = static_cast<T>(randomDouble(rng));
+        return {x, y, z};
     }
 
-    inline static Vec3 random(double min, double max) {
-        return {randomDouble(min, max), randomDouble(min, max), randomDouble(min, max)};
+    inline static Vec3T random(Rng &rng, double min, double max) {
+        auto x = static_cast<T>(randomDouble(rng, min, max));
+        auto y = static_cast<T>(randomDouble(rng, min, max));
+        auto z = static_cast<T>(randomDouble(rng, min, max));
+        return {x, y, z};
     }
 
-    Vec3() : e{0, 0, 0} {}
+    Vec3T() : e{0, 0, 0} {}
+
+    Vec3T(T e0, T e1, T e2) : e{e0, e1, e2} {}
 
-    Vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+    template<typename U>
+    explicit Vec3T(const Vec3T<U> &v) : e{static_cast<T>(v[0]), static_cast<T>(v[1]), static_cast<T>(v[2])} {}
 
-    [[nodiscard]] double x() const { return e[0]; }
+    [[nodiscard]] T x() const { return e[0]; }
 
-    [[nodiscard]] double y() const { return e[1]; }
+    [[nodiscard]] T y() const { return e[1]; }
 
-    [[nodiscard]] double z() const { return e[2]; }
+    [[nodiscard]] T z() const { return e[2]; }
 
-    Vec3 operator-() const { return {-e[0], -e[1], -e[2]}; }
+    Vec3T operator-() const { return {-e[0], -e[1], -e[2]}; }
 
-    double operator[](int i) const { return e[i]; }
+    T operator[](int i) const { return e[i]; }
 
-    double &operator[](int i) { return e[i]; }
+    T &operator[](int i) { return e[i]; }
 
-    Vec3 &operator+=(const Vec3 &v) {
+    Vec3T &operator+=(const Vec3T &v) {
         e[0] += v.e[0];
         e[1] += v.e[1];
         e[2] += v.e[2];
         return *this;
     }
 
-    Vec3 &operator*=(const double t) {
+    Vec3T &operator*=(const T t) {
         e[0] *= t;
         e[1] *= t;
         e[2] *= t;
         return *this;
     }
 
-    Vec3 &operator/=(const double t) {
+    Vec3T &operator/=(const T t) {
         return *this *= 1 / t;
     }
 
 
-    [[nodiscard]] double length() const {
-        return sqrt(lengthSquared());
+    [[nodiscard]] T length() const {
+        return std::sqrt(lengthSquared());
     }
 
-    [[nodiscard]] double lengthSquared() const {
+    [[nodiscard]] T lengthSquared() const {
         return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
     }
 
@@ -66,65 +87,67 @@ public:
      * @return true if the vector is close to zero in all dimensions.
      */
     [[nodiscard]] bool isNearZero() const {
-        const auto s = 1e-8;
+        const auto s = static_cast<T>(1e-8);
         return (std::abs(e[0]) < s) && (std::abs(e[1]) < s) && (std::abs(e[2]) < s);
     }
 
-private:
-    std::array<double, 3> e;
-};
+    // Vec3 Utility Functions
+    // Defined as friends so that scalars of another type (e.g. double literals) convert to T instead of failing deduction.
 
-// Type aliases for Vec3
-using Point3 = Vec3;// 3D point
-using Color = Vec3; // RGB color
+    friend std::ostream &operator<<(std::ostream &out, const Vec3T &v) {
+        return out << v[0] << ' ' << v[1] << ' ' << v[2];
+    }
 
-// Vec3 Utility Functions
+    friend Vec3T operator+(const Vec3T &u, const Vec3T &v) {
+        return {u[0] + v[0], u[1] + v[1], u[2] + v[2]};
+    }
 
-inline std::ostream &operator<<(std::ostream &out, const Vec3 &v) {
-    return out << v[0] << ' ' << v[1] << ' ' << v[2];
-}
+    friend Vec3T operator-(const Vec3T &u, const Vec3T &v) {
+        return {u[0] - v[0], u[1] - v[1], u[2] - v[2]};
+    }
 
-inline Vec3 operator+(const Vec3 &u, const Vec3 &v) {
-    return {u[0] + v[0], u[1] + v[1], u[2] + v[2]};
-}
+    friend Vec3T operator*(const Vec3T &u, const Vec3T &v) {
+        return {u[0] * v[0], u[1] * v[1], u[2] * v[2]};
+    }
 
-inline Vec3 operator-(const Vec3 &u, const Vec3 &v) {
-    return {u[0] - v[0], u[1] - v[1], u[2] - v[2]};
-}
+    friend Vec3T operator*(T t, const Vec3T &v) {
+        return {t * v[0], t * v[1], t * v[2]};
+    }
 
-inline Vec3 operator*(const Vec3 &u, const Vec3 &v) {
-    return {u[0] * v[0], u[1] * v[1], u[2] * v[2]};
-}
+    friend Vec3T operator*(const Vec3T &v, T t) {
+        return t * v;
+    }
 
-inline Vec3 operator*(double t, const Vec3 &v) {
-    return {t * v[0], t * v[1], t * v[2]};
-}
+    friend Vec3T operator/(const Vec3T &v, T t) {
+        return (1 / t) * v;
+    }
 
-inline Vec3 operator*(const Vec3 &v, double t) {
-    return t * v;
-}
+    friend T dot(const Vec3T &u, const Vec3T &v) {
+        return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+    }
 
-inline Vec3 operator/(const Vec3 &v, double t) {
-    return (1 / t) * v;
-}
+    friend Vec3T cross(const Vec3T &u, const Vec3T &v) {
+        return {u[1] * v[2] - u[2] * v[1],
+                u[2] * v[0] - u[0] * v[2],
+                u[0] * v[1] - u[1] * v[0]};
+    }
 
-inline double dot(const Vec3 &u, const Vec3 &v) {
-    return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
-}
+    friend Vec3T unitVector(const Vec3T &v) {
+        return v / v.length();
+    }
 
-inline Vec3 cross(const Vec3 &u, const Vec3 &v) {
-    return {u[1] * v[2] - u[2] * v[1],
-            u[2] * v[0] - u[0] * v[2],
-            u[0] * v[1] - u[1] * v[0]};
-}
+private:
+    std::array<T, 3> e;
+};
 
-inline Vec3 unitVector(const Vec3 &v) {
-    return v / v.length();
-}
+// Type aliases for Vec3
+using Vec3 = Vec3T<Real>;
+using Point3 = Vec3;// 3D point
+using Color = Vec3; // RGB color
 
-Vec3 randomInUnitSphere() {
+Vec3 randomInUnitSphere(Rng &rng) {
     while (true) {
-        auto p = Vec3::random(-1, 1);
+        auto p = Vec3::random(rng, -1, 1);
         if (p.lengthSquared() >= 1) {
             continue;
         }
@@ -132,13 +155,15 @@ Vec3 randomInUnitSphere() {
     }
 }
 
-inline Vec3 randomUnitVector() {
-    return unitVector(randomInUnitSphere());
+inline Vec3 randomUnitVector(Rng &rng) {
+    return unitVector(randomInUnitSphere(rng));
 }
 
-Vec3 randomInUnitDisk() {
+Vec3 randomInUnitDisk(Rng &rng) {
     while (true) {
-        auto p = Vec3(randomDouble(-1, 1), randomDouble(-1, 1), 0);
+        auto x = static_cast<Real>(randomDouble(rng, -1, 1));
+        auto y = static_cast<Real>(randomDouble(rng, -1, 1));
+        auto p = Vec3(x, y, 0);
         if (p.lengthSquared() >= 1) {
             continue;
         }
@@ -0,0 +1,161 @@
+#ifndef RAYTRACER_WAVEFRONT_H
+#define RAYTRACER_WAVEFRONT_H
+
+#include "color.h"
+#include "dielectric.h"
+#include "diffuse_light.h"
+#include "hit_record.h"
+#include "hittable.h"
+#include "lambertian.h"
+#include "lights.h"
+#include "metal.h"
+#include "render_stats.h"
+#include "rng.h"
+#include "russian_roulette.h"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/**
+ * Iterative path tracer that advances a whole batch of paths one bounce at a time.
+ *
+ * Every bounce first intersects all live paths, then groups the hits by material type and shades each group
+ * in one pass. Built-in material types are shaded through their concrete (final) classes, so the scatter code
+ * of a group is resolved statically instead of through a virtual call per path. The shadow rays sampled while
+ * shading are traced together after all groups.
+ *
+ * The path state lives in flat arrays owned by the integrator, so a worker can reuse one instance for all its tiles.
+ */
+class WavefrontIntegrator {
+public:
+    /**
+     * With Russian roulette on, paths may end early depending on their throughput, see russian_roulette::play().
+     */
+    void setRussianRoulette(bool value) {
+        isRoulette = value;
+    }
+
+    /**
+     * Traces every camera ray to completion.
+     *
+     * @param lights of the scene, see Lights.
+     * @param rngs one generator per ray, advanced to the stream of each bounce like the recursive integrator does.
+     * @param radiance receives the radiance carried by each path.
+     * @param features if not null, receives what each camera ray hits first.
+     * @tparam Scene Hittable, or a final class such as ClosedScene whose hit() is then called without virtual calls.
+     */
+    template<typename Scene>
+    void trace(const Scene &scene, const Lights &lights, int maxDepth, const std::vector<Ray> &cameraRays,
+               std::vector<Rng> &rngs, std::vector<Color> &radiance, std::vector<SampleFeatures> *features = nullptr) {
+        const int numPaths = static_cast<int>(cameraRays.size());
+        rays.assign(cameraRays.begin(), cameraRays.end());
+        throughput.assign(numPaths, Color(1, 1, 1));
+        emissionWeight.assign(numPaths, 1);
+        hits.resize(numPaths);
+        radiance.assign(numPaths, Color(0, 0, 0));
+        if (features) {
+            features->resize(numPaths);
+        }
+
+        active.resize(numPaths);
+        for (int i = 0; i < numPaths; i++) {
+            active[i] = i;
+        }
+
+        for (int bounce = 1; bounce <= maxDepth && !active.empty(); bounce++) {
+            for (auto &queue: queues) {
+                queue.clear();
+            }
+
+            // Intersection stage: escaped paths pick up the sky, the rest pick up what they hit emits and are queued
+            // by material.
+            for (int i: active) {
+                RAYTRACER_STAT(localRenderStats.countRay(bounce));
+                hits[i] = scene.hit(rays[i], 0.001, std::numeric_limits<Real>::infinity());
+                if (features && bounce == 1) {
+                    (*features)[i] = hits[i] ? SampleFeatures{hits[i]->material->getAlbedo(), hits[i]->normal, hits[i]->t}
+                                             : SampleFeatures{lights.sky(rays[i].direction()), Vec3(0, 0, 0), 0};
+                }
+                if (!hits[i]) {
+                    RAYTRACER_STAT(localRenderStats.countEscaped(bounce));
+                    radiance[i] += throughput[i] * lights.sky(rays[i].direction());
+                    continue;
+                }
+                RAYTRACER_STAT(localRenderStats.countHit(*hits[i]->material));
+                radiance[i] += throughput[i] * (emissionWeight[i] * hits[i]->material->emitted(*hits[i]));
+                queues[static_cast<int>(hits[i]->material->getType())].push_back(i);
+            }
+
+            // Shading stage, one material type at a time.
+            nextActive.clear();
+            shadowRays.clear();
+            shade<Lambertian>(queues[static_cast<int>(MaterialType::Lambertian)], lights, rngs, bounce);
+            shade<Metal>(queues[static_cast<int>(MaterialType::Metal)], lights, rngs, bounce);
+            shade<Dielectric>(queues[static_cast<int>(MaterialType::Dielectric)], lights, rngs, bounce);
+            shade<DiffuseLight>(queues[static_cast<int>(MaterialType::DiffuseLight)], lights, rngs, bounce);
+            shade<Material>(queues[static_cast<int>(MaterialType::Other)], lights, rngs, bounce);
+
+            // Shadow stage: lights that the shadow rays reach add to their paths.
+            for (const auto &[i, shadowRay]: shadowRays) {
+                RAYTRACER_STAT(localRenderStats.countShadowRay());
+                if (auto rec = scene.hit(shadowRay.ray, 0.001, std::numeric_limits<Real>::infinity())) {
+                    radiance[i] += shadowRay.weight * rec->material->emitted(*rec);
+                }
+            }
+
+            // Keep the surviving paths in camera order so the next intersection stage walks them coherently.
+            std::sort(nextActive.begin(), nextActive.end());
+            std::swap(active, nextActive);
+        }
+        // Paths still alive after maxDepth bounces gather no more light.
+        RAYTRACER_STAT(localRenderStats.countDepthLimited(maxDepth, static_cast<long long>(active.size())));
+    }
+
+private:
+    static constexpr int numMaterialTypes = static_cast<int>(MaterialType::Other) + 1;
+
+    std::vector<Ray> rays;
+    std::vector<Color> throughput;
+    std::vector<Real> emissionWeight;// of the light the path's ray finds, see Lights::emissionWeight()
+    std::vector<std::optional<HitRecord>> hits;
+    std::vector<int> active;
+    std::vector<int> nextActive;
+    std::array<std::vector<int>, numMaterialTypes> queues;
+    std::vector<std::pair<int, Lights::ShadowRay>> shadowRays;// path and shadow ray, weighted by the path's throughput
+    bool isRoulette = false;
+
+    template<typename M>
+    void shade(const std::vector<int> &queue, const Lights &lights, std::vector<Rng> &rngs, int bounce) {
+        for (int i: queue) {
+            const auto &rec = *hits[i];
+            const auto &material = static_cast<const M &>(*rec.material);
+            auto &rng = rngs[i];
+            rng.setBounce(bounce);
+            if (auto scattered = material.scatter(rays[i], rec, rng)) {
+                if (auto shadowRay = lights.sampleShadowRay(rays[i], rec, rng, material)) {
+                    shadowRay->weight = throughput[i] * shadowRay->weight;
+                    shadowRays.emplace_back(i, *shadowRay);
+                }
+                emissionWeight[i] = lights.emissionWeight(rays[i], rec, *scattered, material);
+                throughput[i] = throughput[i] * material.getAlbedo();
+                if (isRoulette) {
+                    double survival = russian_roulette::play(throughput[i], bounce, rng);
+                    if (survival == 0) {
+                        RAYTRACER_STAT(localRenderStats.countRouletteEnded(bounce));
+                        continue;
+                    }
+                    throughput[i] /= survival;
+                }
+                rays[i] = *scattered;
+                nextActive.push_back(i);
+            } else {
+                RAYTRACER_STAT(localRenderStats.countAbsorbed(bounce));
+            }
+        }
+    }
+};
+
+#endif//RAYTRACER_WAVEFRONT_H